@@ -0,0 +1,108 @@
+//
+// Created by Liu Xinan on 19/10/26.
+//
+
+#include <algorithm>
+#include <cstdio>
+#include "ConcurrencyController.h"
+
+
+const double ConcurrencyController::ERROR_RATE_THRESHOLD = 0.2;
+const double ConcurrencyController::DECREASE_FACTOR = 0.75;
+const std::chrono::milliseconds ConcurrencyController::DEFAULT_TIMEOUT = std::chrono::milliseconds(1000);
+
+ConcurrencyController::Job::Job(ConcurrencyController& controller)
+        : controller_(controller) {}
+
+ConcurrencyController::Job::~Job() {
+    controller_.finish_(*this);
+}
+
+ConcurrencyController::ConcurrencyController(size_t min_limit, size_t max_limit)
+        : min_limit_(std::max(min_limit, (size_t) 1)), max_limit_(std::max(max_limit, min_limit)),
+          limit_(std::max(min_limit_, max_limit_ / 4)) {}
+
+void ConcurrencyController::acquire() {
+    std::unique_lock<std::mutex> lock(lock_);
+
+    condition_.wait(lock, [this]() { return this->in_flight_ < (size_t) this->limit_; });
+    ++in_flight_;
+}
+
+std::chrono::milliseconds ConcurrencyController::getInitialTimeout() {
+    std::unique_lock<std::mutex> lock(lock_);
+
+    // Not enough samples to say anything yet.
+    if (latencies_.count() < 16) {
+        return DEFAULT_TIMEOUT;
+    }
+    return latencies_.percentile(99) * 2;
+}
+
+size_t ConcurrencyController::getLimit() {
+    std::unique_lock<std::mutex> lock(lock_);
+
+    return (size_t) limit_;
+}
+
+void ConcurrencyController::setMaxLimit(size_t max_limit) {
+    std::unique_lock<std::mutex> lock(lock_);
+
+    // A higher ceiling is grown into like any other, a lower one applies right away.
+    max_limit_ = std::max(max_limit, min_limit_);
+    limit_ = std::min(limit_, (double) max_limit_);
+}
+
+void ConcurrencyController::finish_(const Job& job) {
+    {  // Acquire lock.
+        std::unique_lock<std::mutex> lock(lock_);
+
+        --in_flight_;
+
+        ++window_jobs_;
+        window_pages_ += job.pages;
+        window_failures_ += job.errors + job.timeouts;
+        window_latencies_.merge(job.latencies);
+        latencies_.merge(job.latencies);
+
+        // Adjust roughly once per round trip of the jobs in flight.
+        if (window_jobs_ >= std::max((size_t) 4, (size_t) limit_ / 4)) {
+            adjust_();
+        }
+    }  // Release lock.
+
+    condition_.notify_all();
+}
+
+void ConcurrencyController::adjust_() {
+    const size_t old_limit = (size_t) limit_;
+
+    const uint32_t requests = window_pages_ + window_failures_;
+    const double error_rate = requests > 0 ? (double) window_failures_ / requests : 0;
+
+    bool congested = error_rate > ERROR_RATE_THRESHOLD;
+    if (window_latencies_.count() > 0) {
+        const auto median = window_latencies_.percentile(50);
+        best_median_ = std::min(best_median_, median);
+        // Response times far above the best we have seen mean requests are queueing up somewhere.
+        congested = congested || median > best_median_ * 4;
+    }
+
+    if (congested) {
+        limit_ = std::max((double) min_limit_, limit_ * DECREASE_FACTOR);
+        slow_start_ = false;
+    } else if (slow_start_) {
+        limit_ = std::min((double) max_limit_, limit_ * 2);
+    } else {
+        limit_ = std::min((double) max_limit_, limit_ + 1);
+    }
+
+    if ((size_t) limit_ != old_limit) {
+        fprintf(stderr, "Concurrency limit adjusted from %zu to %zu (error rate %.2f).\n", old_limit, (size_t) limit_, error_rate);
+    }
+
+    window_jobs_ = 0;
+    window_pages_ = 0;
+    window_failures_ = 0;
+    window_latencies_ = LatencyHistogram();
+}
@@ -0,0 +1,108 @@
+//
+// Created by Liu Xinan on 19/10/26.
+//
+
+#ifndef PARALLELWEBCRAWLER_CONCURRENCYCONTROLLER_H
+#define PARALLELWEBCRAWLER_CONCURRENCYCONTROLLER_H
+
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include "LatencyHistogram.h"
+
+
+/**
+ * Limits the number of crawl jobs in flight and adapts the limit from what the jobs report back.
+ *
+ * The limit grows multiplicatively while nothing goes wrong (slow start), then additively, and shrinks
+ * multiplicatively when a window of jobs sees too many errors or timeouts, or when response times climb far
+ * above the best we have seen, which means we are queueing somewhere.
+ *
+ * It also keeps a global latency histogram, from which the timeout of a fresh connection is derived.
+ */
+class ConcurrencyController {
+public:
+    /**
+     * Holds an in-flight slot for the lifetime of a crawl job, and collects what the job observed.
+     * The slot is given back with the statistics on destruction.
+     */
+    class Job {
+    private:
+        ConcurrencyController& controller_;
+    public:
+        uint32_t pages = 0;
+        uint32_t errors = 0;
+        uint32_t timeouts = 0;
+        LatencyHistogram latencies;
+
+        Job(ConcurrencyController& controller);
+        Job(const Job&) = delete;
+        ~Job();
+    };
+
+private:
+    static const double ERROR_RATE_THRESHOLD;
+    static const double DECREASE_FACTOR;
+    static const std::chrono::milliseconds DEFAULT_TIMEOUT;
+
+    const size_t min_limit_;
+    size_t max_limit_;
+    double limit_;
+    bool slow_start_ = true;
+    size_t in_flight_ = 0;
+
+    // Statistics of the current window.
+    uint32_t window_jobs_ = 0;
+    uint32_t window_pages_ = 0;
+    uint32_t window_failures_ = 0;
+    LatencyHistogram window_latencies_;
+    std::chrono::milliseconds best_median_ = std::chrono::milliseconds::max();
+
+    LatencyHistogram latencies_;
+
+    std::mutex lock_;
+    std::condition_variable condition_;
+
+    void finish_(const Job& job);
+    void adjust_();
+
+public:
+    /**
+     * Creates a controller.
+     *
+     * @param min_limit The lowest concurrency it may go down to.
+     * @param max_limit The highest concurrency it may go up to, usually the size of the thread pool.
+     * @return A controller.
+     */
+    ConcurrencyController(size_t min_limit, size_t max_limit);
+
+    /**
+     * Blocks until another job is allowed to start, and reserves the slot for it.
+     * The slot must be handed over to a Job, which gives it back.
+     */
+    void acquire();
+
+    /**
+     * Gets the timeout to use for a connection to a host we know nothing about, from global latencies.
+     *
+     * @return The timeout.
+     */
+    std::chrono::milliseconds getInitialTimeout();
+
+    /**
+     * Sets the highest concurrency it may go up to. The limit is brought down at once if it is above.
+     *
+     * @param max_limit The highest concurrency.
+     */
+    void setMaxLimit(size_t max_limit);
+
+    /**
+     * Gets the current concurrency limit.
+     *
+     * @return The current limit.
+     */
+    size_t getLimit();
+};
+
+
+#endif //PARALLELWEBCRAWLER_CONCURRENCYCONTROLLER_H
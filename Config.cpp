@@ -0,0 +1,184 @@
+//
+// Created by Liu Xinan on 19/10/26.
+//
+
+#include <cstdio>
+#include <fstream>
+#include "Config.h"
+
+
+const Config::Key Config::KEYS[] = {
+        {"backend",               false},
+        {"verify_peers",          false},
+        {"h2c",                   false},
+        {"recrawl_index",         false},
+        {"control_socket",        false},
+        {"threads",               true},
+        {"max_concurrent_jobs",   true},
+        {"crawling_delay_us",     true},
+        {"max_crawling_delay_us", true},
+        {"max_timeout_ms",        true},
+        {"buffer_size",           true},
+        {"max_body_kib",          true},
+        {"max_header_kib",        true},
+        {"user_agent",            true}
+};
+
+namespace {
+
+std::string trim(const std::string& value) {
+    const size_t start = value.find_first_not_of(" \t\r");
+    if (start == std::string::npos) {
+        return "";
+    }
+    return value.substr(start, value.find_last_not_of(" \t\r") + 1 - start);
+}
+
+}
+
+void Config::load(const std::string& path) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        fprintf(stderr, "Cannot open configuration file %s\n", path.c_str());
+        throw std::string("Cannot open configuration file.");
+    }
+
+    std::string line;
+    for (size_t number = 1; std::getline(file, line); ++number) {
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty()) {
+            continue;
+        }
+
+        const size_t equals = line.find('=');
+        try {
+            if (equals == std::string::npos) {
+                throw std::string("Expected key = value.");
+            }
+            set(trim(line.substr(0, equals)), trim(line.substr(equals + 1)));
+        } catch (const std::string& e) {
+            fprintf(stderr, "Error in configuration file %s at line %zu\n", path.c_str(), number);
+            throw;
+        }
+    }
+}
+
+void Config::set(const std::string& key, const std::string& value) {
+    find_(key);
+
+    if (key == "backend") {
+        if (value != "io_uring" && value != "epoll") {
+            throw "Invalid value for " + key + ": " + value + ", expected io_uring or epoll.";
+        }
+        backend = value == "epoll" ? Reactor::Backend::EPOLL : Reactor::Backend::IO_URING;
+    } else if (key == "verify_peers") {
+        verify_peers = parseBool_(key, value);
+    } else if (key == "h2c") {
+        http2_prior_knowledge = parseBool_(key, value);
+    } else if (key == "recrawl_index") {
+        recrawl_index = value;
+    } else if (key == "control_socket") {
+        control_socket = value;
+    } else if (key == "threads") {
+        threads = parseSize_(key, value, 1, 1024);
+    } else if (key == "max_concurrent_jobs") {
+        max_concurrent_jobs = parseSize_(key, value, 4, 65536);
+    } else if (key == "crawling_delay_us") {
+        crawling_delay = std::chrono::microseconds(parseSize_(key, value, 0, 60000000));
+    } else if (key == "max_crawling_delay_us") {
+        max_crawling_delay = std::chrono::microseconds(parseSize_(key, value, 0, 60000000));
+    } else if (key == "max_timeout_ms") {
+        request.max_timeout = std::chrono::milliseconds(parseSize_(key, value, 250, 600000));
+    } else if (key == "buffer_size") {
+        request.buffer_size = parseSize_(key, value, 1024, 1 << 20);
+    } else if (key == "max_body_kib") {
+        request.max_body_size = parseSize_(key, value, 1, 1 << 20) * 1024;
+    } else if (key == "max_header_kib") {
+        request.max_header_size = parseSize_(key, value, 1, 1 << 10) * 1024;
+    } else if (key == "user_agent") {
+        // Goes into a header line as it is.
+        if (value.empty() || value.find_first_of("\r\n") != std::string::npos) {
+            throw "Invalid value for " + key + ".";
+        }
+        request.user_agent = value;
+    }
+}
+
+std::string Config::get(const std::string& key) const {
+    find_(key);
+
+    if (key == "backend") {
+        return backend == Reactor::Backend::EPOLL ? "epoll" : "io_uring";
+    } else if (key == "verify_peers") {
+        return verify_peers ? "true" : "false";
+    } else if (key == "h2c") {
+        return http2_prior_knowledge ? "true" : "false";
+    } else if (key == "recrawl_index") {
+        return recrawl_index;
+    } else if (key == "control_socket") {
+        return control_socket;
+    } else if (key == "threads") {
+        return std::to_string(threads);
+    } else if (key == "max_concurrent_jobs") {
+        return std::to_string(max_concurrent_jobs);
+    } else if (key == "crawling_delay_us") {
+        return std::to_string(crawling_delay.count());
+    } else if (key == "max_crawling_delay_us") {
+        return std::to_string(max_crawling_delay.count());
+    } else if (key == "max_timeout_ms") {
+        return std::to_string(request.max_timeout.count());
+    } else if (key == "buffer_size") {
+        return std::to_string(request.buffer_size);
+    } else if (key == "max_body_kib") {
+        return std::to_string(request.max_body_size / 1024);
+    } else if (key == "max_header_kib") {
+        return std::to_string(request.max_header_size / 1024);
+    }
+    return request.user_agent;
+}
+
+std::string Config::toString() const {
+    std::string lines;
+    for (const auto& key : KEYS) {
+        lines += std::string(key.name) + " = " + get(key.name) + "\n";
+    }
+    return lines;
+}
+
+bool Config::isLive(const std::string& key) {
+    return find_(key)->is_live;
+}
+
+const Config::Key* Config::find_(const std::string& key) {
+    for (const auto& known : KEYS) {
+        if (key == known.name) {
+            return &known;
+        }
+    }
+    throw "Unknown setting: " + key + ".";
+}
+
+size_t Config::parseSize_(const std::string& key, const std::string& value, size_t min, size_t max) {
+    size_t parsed = 0;
+    size_t length = 0;
+    try {
+        parsed = (size_t) std::stoull(value, &length);
+    } catch (const std::exception& e) {
+        length = 0;
+    }
+    if (length == 0 || length != value.length() || parsed < min || parsed > max) {
+        throw "Invalid value for " + key + ": " + value + ", expected a number from " + std::to_string(min) + " to " +
+              std::to_string(max) + ".";
+    }
+    return parsed;
+}
+
+bool Config::parseBool_(const std::string& key, const std::string& value) {
+    if (value == "true" || value == "yes" || value == "1") {
+        return true;
+    }
+    if (value == "false" || value == "no" || value == "0") {
+        return false;
+    }
+    throw "Invalid value for " + key + ": " + value + ", expected true or false.";
+}
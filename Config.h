@@ -0,0 +1,93 @@
+//
+// Created by Liu Xinan on 19/10/26.
+//
+
+#ifndef PARALLELWEBCRAWLER_CONFIG_H
+#define PARALLELWEBCRAWLER_CONFIG_H
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include "HttpRequest.h"
+#include "Reactor.h"
+
+
+/**
+ * Settings of a crawl, read from a configuration file and overridden from the command line.
+ *
+ * The file has one `key = value` per line, and `#` starts a comment. The same keys are used by `--set key=value`
+ * and by the control socket, through which the live ones can be changed while the crawl runs.
+ *
+ * Not thread safe, the crawler guards its copy.
+ */
+class Config {
+public:
+    // Fixed once the crawl has started.
+    Reactor::Backend backend = Reactor::Backend::IO_URING;
+    bool verify_peers = true;
+    bool http2_prior_knowledge = false;
+    std::string recrawl_index;
+    std::string control_socket;
+
+    // Live. Jobs and connections pick up changes when they start.
+    size_t threads = std::max(std::thread::hardware_concurrency(), 2U);
+    size_t max_concurrent_jobs = 1024;
+    std::chrono::microseconds crawling_delay = std::chrono::microseconds(500);
+    std::chrono::microseconds max_crawling_delay = std::chrono::microseconds(1000000);
+    HttpRequest::Options request;
+
+private:
+    struct Key {
+        const char* name;
+        bool is_live;
+    };
+
+    static const Key KEYS[];
+
+    static const Key* find_(const std::string& key);
+    static size_t parseSize_(const std::string& key, const std::string& value, size_t min, size_t max);
+    static bool parseBool_(const std::string& key, const std::string& value);
+
+public:
+    /**
+     * Reads settings from a file. Throws a string if the file cannot be read or has an invalid line.
+     *
+     * @param path The file.
+     */
+    void load(const std::string& path);
+
+    /**
+     * Sets a setting. Throws a string saying what is wrong if the key is unknown or the value is invalid.
+     *
+     * @param key The name of the setting.
+     * @param value The value, as written in the file.
+     */
+    void set(const std::string& key, const std::string& value);
+
+    /**
+     * Gets a setting. Throws a string if the key is unknown.
+     *
+     * @param key The name of the setting.
+     * @return The value, as written in the file.
+     */
+    std::string get(const std::string& key) const;
+
+    /**
+     * Gets all settings, in the format of the file.
+     *
+     * @return One `key = value` line for each setting.
+     */
+    std::string toString() const;
+
+    /**
+     * Gets whether a setting can be changed while the crawl runs. Throws a string if the key is unknown.
+     *
+     * @param key The name of the setting.
+     * @return Whether the setting is live.
+     */
+    static bool isLive(const std::string& key);
+};
+
+
+#endif //PARALLELWEBCRAWLER_CONFIG_H
@@ -0,0 +1,121 @@
+//
+// Created by Liu Xinan on 19/10/26.
+//
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include "ControlSocket.h"
+
+
+const int ControlSocket::POLL_INTERVAL_MS = 200;
+const size_t ControlSocket::MAX_CLIENTS = 16;
+
+ControlSocket::ControlSocket(const std::string& path, Handler handler)
+        : path_(path), handler_(std::move(handler)) {
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path_.length() >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Control socket path too long: %s\n", path_.c_str());
+        throw std::string("Cannot create control socket.");
+    }
+    strcpy(address.sun_path, path_.c_str());
+
+    // A crawl that did not end cleanly leaves its socket file behind.
+    unlink(path_.c_str());
+    if ((sock_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1 ||
+        bind(sock_, (const sockaddr*) &address, sizeof(address)) == -1 || listen(sock_, 4) == -1) {
+        fprintf(stderr, "Cannot create control socket %s: %s\n", path_.c_str(), strerror(errno));
+        if (sock_ != -1) {
+            close(sock_);
+        }
+        throw std::string("Cannot create control socket.");
+    }
+
+    thread_ = std::thread(&ControlSocket::serve_, this);
+    fprintf(stderr, "Listening for commands on %s\n", path_.c_str());
+}
+
+void ControlSocket::serve_() {
+    // Polled with a timeout, so that a stop is noticed without a client to wake us up.
+    std::vector<pollfd> polled;
+    while (!should_stop_) {
+        polled.assign(1, pollfd{sock_, POLLIN, 0});
+        for (const auto& client : clients_) {
+            polled.push_back(pollfd{client.sock, POLLIN, 0});
+        }
+        if (poll(polled.data(), polled.size(), POLL_INTERVAL_MS) <= 0) {
+            continue;
+        }
+
+        // In the order they were polled, new clients join at the end.
+        size_t kept = 0;
+        for (size_t i = 0; i < clients_.size(); ++i) {
+            if (polled[i + 1].revents != 0 && !serveClient_(clients_[i])) {
+                close(clients_[i].sock);
+                continue;
+            }
+            clients_[kept++] = std::move(clients_[i]);
+        }
+        clients_.resize(kept);
+
+        if (polled[0].revents != 0) {
+            const int client = accept4(sock_, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client != -1 && clients_.size() >= MAX_CLIENTS) {
+                close(client);
+            } else if (client != -1) {
+                clients_.push_back(Client{client, ""});
+            }
+        }
+    }
+
+    for (const auto& client : clients_) {
+        close(client.sock);
+    }
+    clients_.clear();
+}
+
+bool ControlSocket::serveClient_(Client& client) {
+    char buffer[1024];
+    const ssize_t bytes_read = recv(client.sock, buffer, sizeof(buffer), MSG_DONTWAIT);
+    if (bytes_read < 0 && (errno == EAGAIN || errno == EINTR)) {
+        return true;
+    }
+    if (bytes_read <= 0) {
+        return false;
+    }
+    client.received.append(buffer, (size_t) bytes_read);
+
+    size_t end;
+    while ((end = client.received.find('\n')) != std::string::npos) {
+        std::string command = client.received.substr(0, end);
+        client.received.erase(0, end + 1);
+        if (!command.empty() && command.back() == '\r') {
+            command.pop_back();
+        }
+        if (command.empty()) {
+            continue;
+        }
+
+        // Replies are short, a client that does not read them is not worth waiting for.
+        const std::string reply = handler_(command);
+        if (send(client.sock, reply.c_str(), reply.length(), MSG_DONTWAIT | MSG_NOSIGNAL) != (ssize_t) reply.length()) {
+            return false;
+        }
+    }
+
+    // Nobody types commands this long.
+    return client.received.length() <= sizeof(buffer) * 4;
+}
+
+ControlSocket::~ControlSocket() {
+    should_stop_ = true;
+    thread_.join();
+    close(sock_);
+    unlink(path_.c_str());
+}
@@ -0,0 +1,70 @@
+//
+// Created by Liu Xinan on 19/10/26.
+//
+
+#ifndef PARALLELWEBCRAWLER_CONTROLSOCKET_H
+#define PARALLELWEBCRAWLER_CONTROLSOCKET_H
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+/**
+ * A local Unix socket for operators to talk to a running crawl, such as with `socat - UNIX-CONNECT:<path>`.
+ *
+ * Every line received is a command, which is handed to the handler on a thread of the socket's own, and the reply
+ * is sent back. Clients are polled together, so one left connected does not keep the others out.
+ */
+class ControlSocket {
+public:
+    typedef std::function<std::string(const std::string& command)> Handler;
+
+private:
+    struct Client {
+        int sock;
+        std::string received;
+    };
+
+    static const int POLL_INTERVAL_MS;
+    static const size_t MAX_CLIENTS;
+
+    const std::string path_;
+    const Handler handler_;
+    int sock_ = -1;
+    std::atomic<bool> should_stop_{false};
+    std::thread thread_;
+    std::vector<Client> clients_;
+
+    void serve_();
+
+    /**
+     * Reads what a client has sent and answers the commands received in full.
+     *
+     * @param client The client.
+     * @return Whether to keep the client. False once it has hung up or misbehaved.
+     */
+    bool serveClient_(Client& client);
+
+public:
+    /**
+     * Listens on a socket file, replacing any stale one. Throws a string if the socket cannot be created.
+     *
+     * @param path The socket file.
+     * @param handler Runs a command and returns the reply.
+     * @return A listening control socket.
+     */
+    ControlSocket(const std::string& path, Handler handler);
+
+    ControlSocket(const ControlSocket&) = delete;
+
+    /**
+     * Stops listening, waits for the current command to finish, and removes the socket file.
+     */
+    ~ControlSocket();
+};
+
+
+#endif //PARALLELWEBCRAWLER_CONTROLSOCKET_H
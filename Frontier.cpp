@@ -0,0 +1,300 @@
+//
+// Created by Liu Xinan on 19/10/26.
+//
+
+#include <algorithm>
+#include <cassert>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include "Frontier.h"
+
+
+const double Frontier::DEPRIORITIZED_FACTOR = 0.1;
+
+Frontier::Entry::Entry(const Link& link, const LinkInfo& info)
+        : link(link), info(info) {}
+
+Frontier::Frontier(size_t number_of_buckets, size_t number_of_shards, size_t max_links_per_host)
+        : max_links_per_host_(max_links_per_host), buckets_(number_of_buckets) {
+    assert(number_of_buckets > 0);
+    assert(number_of_shards > 0);
+    assert(max_links_per_host > 0);
+    for (size_t i = 0; i < number_of_shards; ++i) {
+        shards_.emplace_back(new Shard());
+    }
+}
+
+void Frontier::addScorer(std::unique_ptr<LinkScorer> scorer, double weight) {
+    assert(weight > 0);
+    total_weight_ += weight;
+    scorers_.emplace_back(std::move(scorer), weight);
+}
+
+void Frontier::merge(const HostBatches& batches) {
+    // Partition by shard and take the urls apart before taking any lock.
+    std::vector<std::vector<const HostBatches::value_type*>> partitions(shards_.size());
+    std::unordered_map<const HostBatches::value_type*, std::vector<TrapDetector::Signature>> signatures;
+    for (const auto& batch : batches) {
+        if (batch.second.empty()) {
+            continue;
+        }
+        partitions[shardIndexOf_(batch.first)].push_back(&batch);
+
+        // In the order the batch is iterated.
+        auto& batch_signatures = signatures[&batch];
+        batch_signatures.reserve(batch.second.size());
+        for (const auto& discovery : batch.second) {
+            batch_signatures.push_back(TrapDetector::analyze(discovery.first));
+        }
+    }
+
+    // Hosts that need a new position in the queue, with their bucket.
+    std::vector<std::pair<std::string, size_t>> requeued;
+
+    for (size_t i = 0; i < partitions.size(); ++i) {
+        if (partitions[i].empty()) {
+            continue;
+        }
+
+        Shard& shard = *shards_[i];
+        {  // Acquire lock.
+            std::unique_lock<std::mutex> lock(shard.lock);
+
+            for (const auto batch : partitions[i]) {
+                mergeHost_(shard, batch->first, batch->second, signatures[batch], requeued);
+            }
+        }  // Release lock.
+    }
+
+    if (requeued.empty()) {
+        return;
+    }
+
+    {  // Acquire lock.
+        std::unique_lock<std::mutex> lock(queue_lock_);
+
+        for (auto& host : requeued) {
+            buckets_[host.second].push_back(std::move(host.first));
+        }
+    }  // Release lock.
+}
+
+size_t Frontier::bootstrap(std::vector<HostBatches>& batches, size_t number_of_threads) {
+    const size_t threads = std::max((size_t) 1, std::min(number_of_threads, shards_.size()));
+    const auto runInParallel = [threads](size_t count, const std::function<void(size_t)>& task) {
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < threads && i < count; ++i) {
+            workers.emplace_back([&task, i, count, threads]() {
+                for (size_t index = i; index < count; index += threads) {
+                    task(index);
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    };
+
+    // Split every batch by shard. Hosts are moved over whole, without copying their links.
+    std::vector<std::vector<HostBatches>> split(batches.size(), std::vector<HostBatches>(shards_.size()));
+    runInParallel(batches.size(), [this, &batches, &split](size_t index) {
+        HostBatches& batch = batches[index];
+        while (!batch.empty()) {
+            auto host = batch.extract(batch.begin());
+            split[index][shardIndexOf_(host.key())].insert(std::move(host));
+        }
+    });
+
+    // Every shard now only needs the hosts that fall under it.
+    std::atomic<size_t> number_of_links{0};
+    runInParallel(shards_.size(), [this, &split, &number_of_links](size_t shard) {
+        HostBatches combined;
+        for (auto& batch : split) {
+            for (auto& host : batch[shard]) {
+                LinkBatch& links = combined[host.first];
+                if (links.empty()) {
+                    links = std::move(host.second);
+                    continue;
+                }
+                for (const auto& link : host.second) {
+                    addToBatch(links, link.first, link.second);
+                }
+            }
+            batch[shard].clear();
+        }
+
+        size_t links = 0;
+        for (const auto& host : combined) {
+            links += host.second.size();
+        }
+        number_of_links += links;
+
+        merge(combined);
+    });
+
+    return number_of_links;
+}
+
+bool Frontier::claim(const std::string& host, const Link& link) {
+    Shard& shard = shardOf_(host);
+
+    {  // Acquire lock.
+        std::unique_lock<std::mutex> lock(shard.lock);
+
+        return shard.visited.insert(link).second;
+    }  // Release lock.
+}
+
+void Frontier::finish(const std::string& host) {
+    Shard& shard = shardOf_(host);
+
+    {  // Acquire lock.
+        std::unique_lock<std::mutex> lock(shard.lock);
+
+        shard.finished_hosts.insert(host);
+        // Nothing more will be merged under this host.
+        shard.patterns.erase(host);
+    }  // Release lock.
+}
+
+bool Frontier::pop(std::string& host, std::vector<Entry>& links) {
+    LinkBatch pending;
+    if (!popHost_(host, pending)) {
+        return false;
+    }
+
+    // Sort outside of the locks.
+    links.clear();
+    links.reserve(pending.size());
+    for (const auto& link : pending) {
+        links.emplace_back(link.first, link.second);
+    }
+    std::stable_sort(links.begin(), links.end(), [](const Entry& lhs, const Entry& rhs) {
+        return lhs.info.score > rhs.info.score;
+    });
+    return true;
+}
+
+Frontier::Shard& Frontier::shardOf_(const std::string& host) {
+    return *shards_[shardIndexOf_(host)];
+}
+
+size_t Frontier::shardIndexOf_(const std::string& host) const {
+    return std::hash<std::string>()(host) % shards_.size();
+}
+
+void Frontier::mergeHost_(Shard& shard, const std::string& host, const LinkBatch& batch,
+                          const std::vector<TrapDetector::Signature>& signatures,
+                          std::vector<std::pair<std::string, size_t>>& requeued) {
+    // We are not interested in crawling this host one more time.
+    if (shard.finished_hosts.find(host) != shard.finished_hosts.end()) {
+        return;
+    }
+
+    auto found = shard.hosts.find(host);
+    const bool is_new = found == shard.hosts.end();
+    TrapDetector::HostPatterns* patterns = nullptr;
+
+    size_t index = 0;
+    for (const auto& discovery : batch) {
+        const TrapDetector::Signature& signature = signatures[index++];
+
+        // Not crawling the same url more than once.
+        if (shard.visited.find(discovery.first) != shard.visited.end()) {
+            continue;
+        }
+
+        LinkInfo* info = nullptr;
+        if (found != shard.hosts.end()) {
+            const auto link = found->second.links.find(discovery.first);
+            if (link != found->second.links.end()) {
+                // Already judged when first discovered, inspecting it again would only skew the host's patterns.
+                link->second.merge(discovery.second);
+                info = &link->second;
+            }
+        }
+
+        if (info == nullptr) {
+            if (patterns == nullptr) {
+                patterns = &shard.patterns[host];
+            }
+            const TrapDetector::Verdict verdict = trap_detector_.inspect(*patterns, signature);
+            const bool is_full = found != shard.hosts.end() && found->second.links.size() >= max_links_per_host_;
+            if (verdict == TrapDetector::Verdict::DROP || is_full) {
+                if (!patterns->is_reported) {
+                    patterns->is_reported = true;
+                    fprintf(stderr, "%s on %s, dropping links such as %s\n",
+                            is_full ? "Too many links pending" : "Crawl trap suspected",
+                            host.c_str(), discovery.first.getUrl().c_str());
+                }
+                continue;
+            }
+
+            if (found == shard.hosts.end()) {
+                found = shard.hosts.emplace(host, Host()).first;
+            }
+            info = &found->second.links.emplace(discovery.first, discovery.second).first->second;
+            info->is_deprioritized = verdict == TrapDetector::Verdict::DEPRIORITIZE;
+        }
+
+        info->score = score_(discovery.first, *info);
+        found->second.score = std::max(found->second.score, info->score);
+    }
+
+    if (found == shard.hosts.end()) {
+        return;
+    }
+
+    // Requeue the host if it is new or has moved up. The old queue position becomes stale and is skipped when popping.
+    Host& entry = found->second;
+    const size_t bucket = bucketOf_(entry.score);
+    if (is_new || bucket != entry.bucket) {
+        entry.bucket = bucket;
+        requeued.emplace_back(host, bucket);
+    }
+}
+
+bool Frontier::popHost_(std::string& host, LinkBatch& links) {
+    std::unique_lock<std::mutex> queue_lock(queue_lock_);
+
+    for (size_t i = buckets_.size(); i-- > 0;) {
+        auto& bucket = buckets_[i];
+        while (!bucket.empty()) {
+            std::string candidate = std::move(bucket.front());
+            bucket.pop_front();
+
+            Shard& shard = shardOf_(candidate);
+            std::unique_lock<std::mutex> shard_lock(shard.lock);
+
+            const auto found = shard.hosts.find(candidate);
+            if (found == shard.hosts.end() || found->second.bucket != i) {
+                // Stale entry, the host has been popped or moved to another bucket.
+                continue;
+            }
+
+            links = std::move(found->second.links);
+            shard.hosts.erase(found);
+            host = std::move(candidate);
+            return true;
+        }
+    }
+    return false;
+}
+
+double Frontier::score_(const Link& link, const LinkInfo& info) const {
+    double score = 0;
+    for (const auto& scorer : scorers_) {
+        score += scorer.first->score(link, info) * scorer.second;
+    }
+    // Kept down for as long as it is pending, however often it is rediscovered.
+    return info.is_deprioritized ? score * DEPRIORITIZED_FACTOR : score;
+}
+
+size_t Frontier::bucketOf_(double score) const {
+    if (total_weight_ <= 0) {
+        return 0;
+    }
+    const auto bucket = (size_t) (score / total_weight_ * buckets_.size());
+    return std::min(bucket, buckets_.size() - 1);
+}
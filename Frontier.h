@@ -0,0 +1,154 @@
+//
+// Created by Liu Xinan on 19/10/26.
+//
+
+#ifndef PARALLELWEBCRAWLER_FRONTIER_H
+#define PARALLELWEBCRAWLER_FRONTIER_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <unordered_map>
+#include <unordered_set>
+#include "Link.h"
+#include "LinkScorer.h"
+#include "TrapDetector.h"
+
+
+/**
+ * The set of links waiting to be crawled, grouped by host, together with the set of visited links.
+ *
+ * Hosts are kept in a bucketed priority queue keyed by the best score among their pending links, so the most
+ * valuable host is handed out first and hosts of equal value are still handed out in FIFO order.
+ * Scores are computed by a weighted sum of pluggable scorers whenever a link is added or rediscovered.
+ *
+ * Discovered links go through a trap detector first, which drops or deprioritizes links that look like they come
+ * from an endless url space, and no host may have more than a fixed number of links pending.
+ *
+ * Thread safe. Hosts are sharded by hash, each shard with its own lock, and updates are applied in batches
+ * so that a crawl job takes each lock at most once. Lock order is queue lock, then shard lock.
+ */
+class Frontier {
+public:
+    /**
+     * A link handed out by the frontier, with its statistics.
+     */
+    struct Entry {
+        Link link;
+        LinkInfo info;
+
+        Entry(const Link& link, const LinkInfo& info);
+    };
+
+    /**
+     * Batches of discovered links, keyed by host.
+     */
+    typedef std::unordered_map<std::string, LinkBatch> HostBatches;
+
+private:
+    struct Host {
+        LinkBatch links;
+        double score = 0;
+        size_t bucket = 0;
+    };
+
+    struct Shard {
+        std::mutex lock;
+        std::unordered_map<std::string, Host> hosts;
+        std::unordered_map<std::string, TrapDetector::HostPatterns> patterns;
+        std::unordered_set<std::string> finished_hosts;
+        std::unordered_set<Link> visited;
+    };
+
+    static const double DEPRIORITIZED_FACTOR;
+
+    std::vector<std::pair<std::unique_ptr<LinkScorer>, double>> scorers_;
+    double total_weight_ = 0;
+
+    TrapDetector trap_detector_;
+    const size_t max_links_per_host_;
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+
+    std::vector<std::deque<std::string>> buckets_;
+    std::mutex queue_lock_;
+
+    Shard& shardOf_(const std::string& host);
+    size_t shardIndexOf_(const std::string& host) const;
+    void mergeHost_(Shard& shard, const std::string& host, const LinkBatch& batch,
+                    const std::vector<TrapDetector::Signature>& signatures,
+                    std::vector<std::pair<std::string, size_t>>& requeued);
+    bool popHost_(std::string& host, LinkBatch& links);
+    double score_(const Link& link, const LinkInfo& info) const;
+    size_t bucketOf_(double score) const;
+
+public:
+    /**
+     * Creates an empty frontier.
+     *
+     * @param number_of_buckets The resolution of the host priority queue.
+     * @param number_of_shards The number of independently locked shards.
+     * @param max_links_per_host The most links a host may have pending. Newly discovered links beyond are dropped.
+     * @return An empty frontier.
+     */
+    Frontier(size_t number_of_buckets = 64, size_t number_of_shards = 16, size_t max_links_per_host = 4096);
+
+    /**
+     * Adds a scorer. The priority of a link is the weighted sum of all scorers.
+     * Not thread safe, all scorers must be added before the frontier is shared.
+     *
+     * @param scorer The scorer to add.
+     * @param weight The weight of the scorer.
+     */
+    void addScorer(std::unique_ptr<LinkScorer> scorer, double weight);
+
+    /**
+     * Merges batches of discovered links into the frontier, rescoring the links that changed.
+     * Links that have been visited, hosts that have been finished and links that look like crawl traps are dropped.
+     *
+     * @param batches The discovered links, keyed by host.
+     */
+    void merge(const HostBatches& batches);
+
+    /**
+     * Merges the seed links of the crawl, like merge() but in parallel and in one pass: the batches are split by
+     * shard, then every shard combines its hosts from all batches, dropping duplicate links, and merges them under a
+     * single lock. Meant for large seed lists, before the frontier is shared.
+     *
+     * @param batches Batches of seeds, such as one from each thread that parsed them. Emptied.
+     * @param number_of_threads The most threads to use.
+     * @return The number of distinct seed links.
+     */
+    size_t bootstrap(std::vector<HostBatches>& batches, size_t number_of_threads);
+
+    /**
+     * Marks a link as visited.
+     *
+     * @param host The host of the link.
+     * @param link The link to claim.
+     * @return Whether the link was claimed. False if it has already been visited by someone else.
+     */
+    bool claim(const std::string& host, const Link& link);
+
+    /**
+     * Marks a host as finished. Links discovered under it later are dropped.
+     *
+     * @param host The host.
+     */
+    void finish(const std::string& host);
+
+    /**
+     * Removes the most valuable host and all its pending links from the frontier.
+     *
+     * @param host Set to the popped host.
+     * @param links Set to the links of the host, most valuable first.
+     * @return Whether a host was popped. False if the frontier is empty.
+     */
+    bool pop(std::string& host, std::vector<Entry>& links);
+};
+
+
+#endif //PARALLELWEBCRAWLER_FRONTIER_H
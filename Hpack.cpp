@@ -0,0 +1,342 @@
+//
+// Created by Liu Xinan on 19/10/26.
+//
+
+#include <algorithm>
+#include "Hpack.h"
+
+
+const Hpack::Header Hpack::STATIC_TABLE[] = {
+        {":authority", ""},
+        {":method", "GET"},
+        {":method", "POST"},
+        {":path", "/"},
+        {":path", "/index.html"},
+        {":scheme", "http"},
+        {":scheme", "https"},
+        {":status", "200"},
+        {":status", "204"},
+        {":status", "206"},
+        {":status", "304"},
+        {":status", "400"},
+        {":status", "404"},
+        {":status", "500"},
+        {"accept-charset", ""},
+        {"accept-encoding", "gzip, deflate"},
+        {"accept-language", ""},
+        {"accept-ranges", ""},
+        {"accept", ""},
+        {"access-control-allow-origin", ""},
+        {"age", ""},
+        {"allow", ""},
+        {"authorization", ""},
+        {"cache-control", ""},
+        {"content-disposition", ""},
+        {"content-encoding", ""},
+        {"content-language", ""},
+        {"content-length", ""},
+        {"content-location", ""},
+        {"content-range", ""},
+        {"content-type", ""},
+        {"cookie", ""},
+        {"date", ""},
+        {"etag", ""},
+        {"expect", ""},
+        {"expires", ""},
+        {"from", ""},
+        {"host", ""},
+        {"if-match", ""},
+        {"if-modified-since", ""},
+        {"if-none-match", ""},
+        {"if-range", ""},
+        {"if-unmodified-since", ""},
+        {"last-modified", ""},
+        {"link", ""},
+        {"location", ""},
+        {"max-forwards", ""},
+        {"proxy-authenticate", ""},
+        {"proxy-authorization", ""},
+        {"range", ""},
+        {"referer", ""},
+        {"refresh", ""},
+        {"retry-after", ""},
+        {"server", ""},
+        {"set-cookie", ""},
+        {"strict-transport-security", ""},
+        {"transfer-encoding", ""},
+        {"user-agent", ""},
+        {"vary", ""},
+        {"via", ""},
+        {"www-authenticate", ""},
+};
+const size_t Hpack::STATIC_TABLE_SIZE = sizeof(STATIC_TABLE) / sizeof(STATIC_TABLE[0]);
+const size_t Hpack::ENTRY_OVERHEAD = 32;
+
+namespace {
+
+/**
+ * The Huffman code of every octet, and of the end of string as symbol 256.
+ */
+const struct {
+    uint32_t code;
+    uint8_t length;
+} HUFFMAN_CODES[257] = {
+        {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28}, {0xfffffe4, 28}, {0xfffffe5, 28},
+        {0xfffffe6, 28}, {0xfffffe7, 28}, {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+        {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28}, {0xfffffed, 28}, {0xfffffee, 28},
+        {0xfffffef, 28}, {0xffffff0, 28}, {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+        {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28}, {0xffffff8, 28}, {0xffffff9, 28},
+        {0xffffffa, 28}, {0xffffffb, 28}, {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+        {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11}, {0x3fa, 10}, {0x3fb, 10},
+        {0xf9, 8}, {0x7fb, 11}, {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+        {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6}, {0x1a, 6}, {0x1b, 6},
+        {0x1c, 6}, {0x1d, 6}, {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+        {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10}, {0x1ffa, 13}, {0x21, 6},
+        {0x5d, 7}, {0x5e, 7}, {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+        {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7}, {0x67, 7}, {0x68, 7},
+        {0x69, 7}, {0x6a, 7}, {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+        {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7}, {0xfc, 8}, {0x73, 7},
+        {0xfd, 8}, {0x1ffb, 13}, {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+        {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5}, {0x24, 6}, {0x5, 5},
+        {0x25, 6}, {0x26, 6}, {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+        {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5}, {0x2b, 6}, {0x76, 7},
+        {0x2c, 6}, {0x8, 5}, {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+        {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15}, {0x7fc, 11}, {0x3ffd, 14},
+        {0x1ffd, 13}, {0xffffffc, 28}, {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+        {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23}, {0x3fffd6, 22}, {0x7fffda, 23},
+        {0x7fffdb, 23}, {0x7fffdc, 23}, {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+        {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23}, {0xffffee, 24}, {0x7fffe1, 23},
+        {0x7fffe2, 23}, {0x7fffe3, 23}, {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+        {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24}, {0x3fffda, 22}, {0x1fffdd, 21},
+        {0xfffe9, 20}, {0x3fffdb, 22}, {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+        {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24}, {0x1fffdf, 21}, {0x3fffdf, 22},
+        {0x7fffeb, 23}, {0x7fffec, 23}, {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+        {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23}, {0xfffea, 20}, {0x3fffe2, 22},
+        {0x3fffe3, 22}, {0x3fffe4, 22}, {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+        {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19}, {0x3fffe7, 22}, {0x7ffff2, 23},
+        {0x3fffe8, 22}, {0x1ffffec, 25}, {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+        {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25}, {0x7fff2, 19}, {0x1fffe3, 21},
+        {0x3ffffe6, 26}, {0x7ffffe0, 27}, {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+        {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26}, {0xffffffd, 28}, {0x7ffffe3, 27},
+        {0x7ffffe4, 27}, {0x7ffffe5, 27}, {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+        {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23}, {0x3fffea, 22}, {0x3fffeb, 22},
+        {0x1ffffee, 25}, {0x1ffffef, 25}, {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+        {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26}, {0x7ffffe7, 27}, {0x7ffffe8, 27},
+        {0x7ffffe9, 27}, {0x7ffffea, 27}, {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+        {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26}, {0x3fffffff, 30},
+};
+
+/**
+ * The code is canonical: codes of the same length are consecutive and ordered, so a code can be decoded by
+ * comparing it to the first code of its length instead of walking a tree.
+ */
+struct HuffmanDecoder {
+    static const unsigned MAX_LENGTH = 30;
+
+    uint32_t first_code[MAX_LENGTH + 1] = {};
+    uint32_t count[MAX_LENGTH + 1] = {};
+    uint32_t offset[MAX_LENGTH + 1] = {};
+    uint16_t symbols[257];
+
+    HuffmanDecoder() {
+        for (uint16_t symbol = 0; symbol < 257; ++symbol) {
+            symbols[symbol] = symbol;
+            ++count[HUFFMAN_CODES[symbol].length];
+        }
+        std::sort(symbols, symbols + 257, [](uint16_t a, uint16_t b) {
+            return HUFFMAN_CODES[a].length != HUFFMAN_CODES[b].length ?
+                   HUFFMAN_CODES[a].length < HUFFMAN_CODES[b].length : HUFFMAN_CODES[a].code < HUFFMAN_CODES[b].code;
+        });
+
+        uint32_t code = 0;
+        uint32_t position = 0;
+        for (unsigned length = 1; length <= MAX_LENGTH; ++length) {
+            first_code[length] = code;
+            offset[length] = position;
+            code = (code + count[length]) << 1;
+            position += count[length];
+        }
+    }
+};
+
+const HuffmanDecoder HUFFMAN_DECODER;
+
+}
+
+Hpack::Decoder::Decoder(size_t table_size_limit)
+        : max_table_size_(table_size_limit), table_size_limit_(table_size_limit) {}
+
+Hpack::Headers Hpack::Decoder::decode(const std::string& block) {
+    Headers headers;
+    size_t position = 0;
+    while (position < block.length()) {
+        const uint8_t first = (uint8_t) block[position];
+
+        if (first & 0x80) {
+            // Indexed header field.
+            const uint64_t index = decodeInteger_(block, position, 7);
+            headers.push_back(lookup_(index));
+        } else if ((first & 0xe0) == 0x20) {
+            // Dynamic table size update.
+            const uint64_t size = decodeInteger_(block, position, 5);
+            if (size > table_size_limit_) {
+                throw std::string("HPACK table size over the limit.");
+            }
+            max_table_size_ = (size_t) size;
+            evict_(max_table_size_);
+        } else {
+            // Literals, with incremental indexing (01), without indexing (0000) or never indexed (0001).
+            const bool is_indexed = (first & 0xc0) == 0x40;
+            const uint64_t name_index = decodeInteger_(block, position, is_indexed ? 6 : 4);
+            Header header;
+            header.first = name_index == 0 ? decodeString_(block, position) : lookup_(name_index).first;
+            header.second = decodeString_(block, position);
+
+            if (is_indexed) {
+                const size_t size = header.first.length() + header.second.length() + ENTRY_OVERHEAD;
+                // An entry larger than the whole table just empties it.
+                evict_(size > max_table_size_ ? 0 : max_table_size_ - size);
+                if (size <= max_table_size_) {
+                    table_.push_front(header);
+                    table_size_ += size;
+                }
+            }
+            headers.push_back(std::move(header));
+        }
+    }
+    return headers;
+}
+
+void Hpack::Decoder::evict_(size_t max_size) {
+    while (table_size_ > max_size) {
+        const Header& oldest = table_.back();
+        table_size_ -= oldest.first.length() + oldest.second.length() + ENTRY_OVERHEAD;
+        table_.pop_back();
+    }
+}
+
+const Hpack::Header& Hpack::Decoder::lookup_(uint64_t index) const {
+    if (index == 0 || index > STATIC_TABLE_SIZE + table_.size()) {
+        throw std::string("HPACK index out of range.");
+    }
+    if (index <= STATIC_TABLE_SIZE) {
+        return STATIC_TABLE[index - 1];
+    }
+    return table_[index - STATIC_TABLE_SIZE - 1];
+}
+
+void Hpack::encode(const std::string& name, const std::string& value, std::string& block) {
+    size_t name_index = 0;
+    for (size_t i = 0; i < STATIC_TABLE_SIZE; ++i) {
+        if (STATIC_TABLE[i].first == name) {
+            if (STATIC_TABLE[i].second == value) {
+                // The whole header is in the static table, such as :method GET.
+                encodeInteger_(i + 1, 7, 0x80, block);
+                return;
+            }
+            if (name_index == 0) {
+                name_index = i + 1;
+            }
+        }
+    }
+
+    // Literal header field never indexed, with the name taken from the static table when it is there.
+    encodeInteger_(name_index, 4, 0x10, block);
+    if (name_index == 0) {
+        encodeString_(name, block);
+    }
+    encodeString_(value, block);
+}
+
+void Hpack::encodeInteger_(uint64_t value, unsigned prefix_bits, uint8_t flags, std::string& block) {
+    const uint64_t max_prefix = (1u << prefix_bits) - 1;
+    if (value < max_prefix) {
+        block += (char) (flags | value);
+        return;
+    }
+    block += (char) (flags | max_prefix);
+    value -= max_prefix;
+    while (value >= 0x80) {
+        block += (char) (0x80 | (value & 0x7f));
+        value >>= 7;
+    }
+    block += (char) value;
+}
+
+uint64_t Hpack::decodeInteger_(const std::string& block, size_t& position, unsigned prefix_bits) {
+    const uint64_t max_prefix = (1u << prefix_bits) - 1;
+    uint64_t value = (uint8_t) block[position++] & max_prefix;
+    if (value < max_prefix) {
+        return value;
+    }
+
+    for (unsigned shift = 0; shift <= 28; shift += 7) {
+        if (position >= block.length()) {
+            throw std::string("HPACK integer truncated.");
+        }
+        const uint8_t byte = (uint8_t) block[position++];
+        value += (uint64_t) (byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+    throw std::string("HPACK integer too large.");
+}
+
+void Hpack::encodeString_(const std::string& value, std::string& block) {
+    // Our headers are too short for Huffman coding to be worth it.
+    encodeInteger_(value.length(), 7, 0x00, block);
+    block += value;
+}
+
+std::string Hpack::decodeString_(const std::string& block, size_t& position) {
+    if (position >= block.length()) {
+        throw std::string("HPACK string truncated.");
+    }
+    const bool is_huffman = (uint8_t) block[position] & 0x80;
+    const uint64_t length = decodeInteger_(block, position, 7);
+    if (length > block.length() - position) {
+        throw std::string("HPACK string truncated.");
+    }
+
+    const size_t start = position;
+    position += (size_t) length;
+    if (is_huffman) {
+        return decodeHuffman_(block, start, position);
+    }
+    return block.substr(start, (size_t) length);
+}
+
+std::string Hpack::decodeHuffman_(const std::string& block, size_t start, size_t end) {
+    const HuffmanDecoder& decoder = HUFFMAN_DECODER;
+
+    std::string value;
+    uint32_t code = 0;
+    unsigned length = 0;
+    for (size_t i = start; i < end; ++i) {
+        const uint8_t byte = (uint8_t) block[i];
+        for (int bit = 7; bit >= 0; --bit) {
+            code = (code << 1) | ((byte >> bit) & 1);
+            if (++length > HuffmanDecoder::MAX_LENGTH) {
+                throw std::string("HPACK Huffman code invalid.");
+            }
+
+            const uint32_t index = code - decoder.first_code[length];
+            if (code >= decoder.first_code[length] && index < decoder.count[length]) {
+                const uint16_t symbol = decoder.symbols[decoder.offset[length] + index];
+                if (symbol == 256) {
+                    throw std::string("HPACK Huffman string contains the end of string.");
+                }
+                value += (char) symbol;
+                code = 0;
+                length = 0;
+            }
+        }
+    }
+
+    // What is left must be a short padding of ones, the start of the end of string code.
+    if (length > 7 || code != (1u << length) - 1) {
+        throw std::string("HPACK Huffman padding invalid.");
+    }
+    return value;
+}
@@ -0,0 +1,83 @@
+//
+// Created by Liu Xinan on 19/10/26.
+//
+
+#ifndef PARALLELWEBCRAWLER_HPACK_H
+#define PARALLELWEBCRAWLER_HPACK_H
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+/**
+ * Header compression of HTTP/2 (HPACK).
+ *
+ * Decoding is complete, with the dynamic table and Huffman coded strings, since servers encode however they like.
+ * Encoding only refers to the static table and never indexes, which is all a client sending a handful of
+ * headers needs, and leaves the server's table of our headers empty.
+ */
+class Hpack {
+public:
+    typedef std::pair<std::string, std::string> Header;
+    typedef std::vector<Header> Headers;
+
+    /**
+     * Decodes the header blocks of one connection, in the order they were received.
+     * Not thread safe.
+     */
+    class Decoder {
+    private:
+        // Newest first, as it is indexed.
+        std::deque<Header> table_;
+        size_t table_size_ = 0;
+        size_t max_table_size_;
+        size_t table_size_limit_;
+
+        void evict_(size_t max_size);
+        const Header& lookup_(uint64_t index) const;
+
+    public:
+        /**
+         * Creates a decoder with an empty dynamic table.
+         *
+         * @param table_size_limit The largest dynamic table the server may use, as we advertise it.
+         * @return A new decoder.
+         */
+        Decoder(size_t table_size_limit = 4096);
+
+        /**
+         * Decodes a complete header block. Throws a string if the block is malformed, after which the decoder
+         * is out of sync with the server and the connection must be dropped.
+         *
+         * @param block The header block, put back together from all its frames.
+         * @return The headers, in order.
+         */
+        Headers decode(const std::string& block);
+    };
+
+    /**
+     * Appends a header to a header block, as a literal that is never indexed.
+     *
+     * @param name The name of the header, in lower case.
+     * @param value The value of the header.
+     * @param block The header block to append to.
+     */
+    static void encode(const std::string& name, const std::string& value, std::string& block);
+
+private:
+    static const Header STATIC_TABLE[];
+    static const size_t STATIC_TABLE_SIZE;
+    static const size_t ENTRY_OVERHEAD;
+
+    static void encodeInteger_(uint64_t value, unsigned prefix_bits, uint8_t flags, std::string& block);
+    static uint64_t decodeInteger_(const std::string& block, size_t& position, unsigned prefix_bits);
+    static void encodeString_(const std::string& value, std::string& block);
+    static std::string decodeString_(const std::string& block, size_t& position);
+    static std::string decodeHuffman_(const std::string& block, size_t start, size_t end);
+};
+
+
+#endif //PARALLELWEBCRAWLER_HPACK_H
@@ -3,205 +3,843 @@
 //
 
 #include <netdb.h>
-#include <unistd.h>
-#include <fcntl.h>
+#include <openssl/err.h>
+#include <algorithm>
 #include <cerrno>
-#include <cassert>
 #include <cstring>
 #include "HttpRequest.h"
 
 
-const std::regex HttpRequest::CONTENT_LENGTH_RE = std::regex("Content-Length: (\\d+)\r\n");
-const std::regex HttpRequest::CONNECTION_CLOSE_RE = std::regex("Connection: close\r\n");
-const std::regex HttpRequest::CHUNKED_ENCODING_RE = std::regex("Transfer-Encoding: chunked\r\n");
-const size_t HttpRequest::BUFFER_SIZE = 1024;
+// Header names are case insensitive, and so are these values.
+const std::regex HttpRequest::CONTENT_LENGTH_RE = std::regex("\r\nContent-Length: *(\\d+) *\r\n", std::regex::icase);
+const std::regex HttpRequest::CONNECTION_CLOSE_RE = std::regex("\r\nConnection: *close *\r\n", std::regex::icase);
+const std::regex HttpRequest::CONNECTION_KEEP_ALIVE_RE = std::regex("\r\nConnection: *keep-alive *\r\n",
+                                                                    std::regex::icase);
+const std::regex HttpRequest::CHUNKED_ENCODING_RE = std::regex("\r\nTransfer-Encoding: *chunked *\r\n",
+                                                               std::regex::icase);
+const std::regex HttpRequest::CONTENT_TYPE_RE = std::regex("\r\nContent-Type: *([^;\r ]*)", std::regex::icase);
+const size_t HttpRequest::MAX_DRAIN_SIZE = 64 * 1024;
+const std::chrono::milliseconds HttpRequest::MIN_TIMEOUT = std::chrono::milliseconds(250);
+const std::string HttpRequest::DEFAULT_USER_AGENT = "Mozilla/5.0 (compatible; Homework/0.1; +https://myaces.nus.edu.sg/cors/jsp/report/ModuleDetailedInfo.jsp?acad_y=2016/2017&sem_c=2&mod_c=CS3103)";
+const std::string HttpRequest::HTTP2_PREFACE = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+const uint32_t HttpRequest::HTTP2_WINDOW_SIZE = 1 << 24;
+const uint32_t HttpRequest::HTTP2_STREAM_WINDOW_SIZE = 1 << 20;
+const uint32_t HttpRequest::MAX_STREAMS = 32;
 
-HttpRequest::HttpRequest(const std::string& hostname, const std::string& port)
-        : hostname_(hostname), port_(port) {}
+namespace {
 
-void HttpRequest::open() {
-    addrinfo hints;
-    addrinfo *result, *host;
+/**
+ * Whether a media type may be a page with links. Unknown and generic types are left to the first bytes.
+ */
+bool isHtmlType(std::string type) {
+    std::transform(type.cbegin(), type.cend(), type.begin(), ::tolower);
+    return type.empty() || type == "application/octet-stream" || type == "text/plain" ||
+           type.find("html") != std::string::npos || type.find("xml") != std::string::npos;
+}
 
-    memset(&hints, 0, sizeof(struct addrinfo));
-    hints.ai_family = AF_UNSPEC;
-    hints.ai_socktype = SOCK_STREAM;
+/**
+ * Whether the first bytes of a body are those of a binary file, by the signatures of common formats or by
+ * control characters that never appear in text.
+ */
+bool isBinary(const char* data, size_t length) {
+    static const std::string SIGNATURES[] = {
+            "%PDF-", "\x89PNG", "GIF8", "\xff\xd8\xff", "PK\x03\x04", "\x1f\x8b", "Rar!", "7z\xbc\xaf",
+            "OggS", "ID3", "fLaC", "RIFF", "\x7f" "ELF", "wOFF", "wOF2", std::string("\0asm", 4)
+    };
+    static const size_t SNIFF_SIZE = 512;
 
-    // Resolve the hostname.
-    if (getaddrinfo(hostname_.c_str(), port_.c_str(), &hints, &result) != 0) {
-        fprintf(stderr, "Error resolving hostname: %s at port %s\n", hostname_.c_str(), port_.c_str());
-        throw std::string("Hostname resolution failed.");
+    const std::string start(data, std::min(length, SNIFF_SIZE));
+    for (const auto& signature : SIGNATURES) {
+        if (start.compare(0, signature.length(), signature) == 0) {
+            return true;
+        }
+    }
+    // Byte order marks of UTF-16, which is full of zeros.
+    if (start.compare(0, 2, "\xff\xfe") == 0 || start.compare(0, 2, "\xfe\xff") == 0) {
+        return false;
+    }
+    return std::any_of(start.cbegin(), start.cend(), [](char c) {
+        return (c >= 0 && c <= 8) || c == 0x0b || (c >= 0x0e && c <= 0x1a) || (c >= 0x1c && c <= 0x1f);
+    });
+}
+
+}
+
+HttpRequest::HttpRequest(Reactor& reactor, const std::string& hostname, const std::string& port, TlsContext* tls,
+                         bool http2_prior_knowledge)
+        : reactor_(reactor), hostname_(hostname), port_(port), origin_(hostname + ":" + port),
+          authority_(port == (tls != nullptr ? "443" : "80") ? hostname : hostname + ":" + port), tls_(tls),
+          http2_prior_knowledge_(http2_prior_knowledge && tls == nullptr) {}
+
+Task<void> HttpRequest::open() {
+    // Whatever is left of the last connection is of no use anymore.
+    close_();
+    if (buffer_size_ != options_.buffer_size) {
+        buffer_size_ = options_.buffer_size;
+        buffer_.reset(new char[buffer_size_]);
     }
 
+    // Resolve the hostname.
+    const Reactor::AddressList result = co_await reactor_.resolve(hostname_, port_);
 
     // Find the first DNS record that we can connect to.
-    for (host = result; host != NULL; host = host->ai_next) {
-        if ((sock_ = socket(host->ai_family, host->ai_socktype, host->ai_protocol)) == -1) {
+    addrinfo* host;
+    for (host = result.get(); host != nullptr; host = host->ai_next) {
+        // The socket is non-blocking so that we can wait for it on the reactor, with a timeout.
+        if ((sock_ = socket(host->ai_family, host->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, host->ai_protocol)) == -1) {
             continue;
-        } else {
-            // Set socket to non-blocking so that we can use select() to set a timeout.
-            set_socket_blocking_(false);
-            if (connect(sock_, host->ai_addr, host->ai_addrlen) < 0) {
-                // For a non-blocking socket, connect() returns immediately and sets errno to EINPROGRESS.
-                if (errno == EINPROGRESS) {
-                    FD_ZERO(&fds_);
-                    FD_SET(sock_, &fds_);
-                    if (select(sock_ + 1, nullptr, &fds_, nullptr, &timeout_) > 0) {
-                        int error;
-                        socklen_t error_len = sizeof(error);
-                        // A failed socket is also writable. So we need to check the socket options.
-                        if (getsockopt(sock_, SOL_SOCKET, SO_ERROR, &error, &error_len) >= 0 && !error) {
-                            // Set it back to blocking mode.
-                            set_socket_blocking_(true);
-                            // Set timeout for socket read/write.
-                            setsockopt(sock_, SOL_SOCKET, SO_RCVTIMEO, &timeout_, sizeof(timeout_));
-                            setsockopt(sock_, SOL_SOCKET, SO_SNDTIMEO, &timeout_, sizeof(timeout_));
-                            break;
-                        }
-                    }
-                }
-            }
-            close(sock_);
         }
-    }
 
-    freeaddrinfo(result);
+        const ssize_t result = co_await reactor_.connect(sock_, host->ai_addr, host->ai_addrlen, deadline_());
+        if (result == 0) {
+            break;
+        }
+        if (result == -ETIMEDOUT) {
+            ++timeouts_;
+        }
+        reactor_.close(sock_);
+        sock_ = -1;
+    }
 
     if (host == nullptr) {
         fprintf(stderr, "Error connecting to host: %s at port %s\n", hostname_.c_str(), port_.c_str());
         throw std::string("Connection failed.");
     }
+
+    if (tls_ != nullptr) {
+        co_await handshake_();
+    }
+
+    if (http2_prior_knowledge_) {
+        is_http2_ = true;
+    }
+    if (is_http2_) {
+        co_await startHttp2_();
+    }
+    is_open_ = true;
+}
+
+bool HttpRequest::isOpen() const {
+    return is_open_ && !is_going_away_;
+}
+
+Task<WebPage> HttpRequest::get(std::string path, Validators validators) {
+    if (!isOpen()) {
+        co_await open();
+    }
+
+    if (is_http2_) {
+        std::vector<std::pair<size_t, WebPage>> pages = co_await getAll(std::vector<std::string>(1, path),
+                                                                        std::vector<Validators>(1, validators));
+        if (pages.empty()) {
+            throw std::string("Stream reset.");
+        }
+        co_return std::move(pages.front().second);
+    }
+
+    const bool is_reused = connection_requests_ > 0;
+    const uint64_t bytes_received = bytes_received_;
+    try {
+        co_return co_await fetch_(path, validators);
+    } catch (const std::string&) {
+        // Hosts close connections that have been idle for a while, and may do so just as we send on one. If
+        // nothing came back, the request was never handled and can safely be sent again.
+        if (!is_reused || !is_closed_by_host_ || bytes_received_ != bytes_received) {
+            throw;
+        }
+    }
+
+    co_await open();
+    co_return co_await fetch_(path, validators);
 }
 
-WebPage HttpRequest::get(const std::string& path) {
+Task<WebPage> HttpRequest::fetch_(const std::string& path, const Validators& validators) {
+    // Only trusted again once the whole response is in.
+    is_open_ = false;
     ++requests_made_;
+    ++connection_requests_;
 
     {  // Send the GET request header to the server.
-        std::string request_header = constructGetHeader_(path);
+        std::string request_header = constructGetHeader_(path, validators);
 
-        write_(request_header);
+        co_await write_(request_header);
     }
 
     const auto send_time = std::chrono::steady_clock::now();
 
     // Read the header only, to decide what to do.
-    std::string response = readHeader_();
+    std::string response = co_await readHeader_();
 
     const auto receive_time = std::chrono::steady_clock::now();
-    total_response_time_ += std::chrono::duration_cast<std::chrono::milliseconds>(receive_time - send_time);
-
-    bool chunked_encoding = false;
+    recordResponseTime_(std::chrono::duration_cast<std::chrono::milliseconds>(receive_time - send_time));
 
     std::smatch matches;
-    size_t content_length = 0;
-    if (std::regex_search(response, matches, CONNECTION_CLOSE_RE)) {
-        throw std::string("Connection closed.");
-    } else if (std::regex_search(response, matches, CONTENT_LENGTH_RE)) {
-        content_length = (size_t) std::stoi(matches[1]);
-    } else if (std::regex_search(response, matches, CHUNKED_ENCODING_RE)) {
-        chunked_encoding = true;
-    } else {
-        throw std::string("No content length nor chunked encoding.");
+    const std::string code = response.compare(0, 5, "HTTP/") == 0 ? response.substr(9, 3) : "";
+    // HTTP/1.0 hosts close the connection after every response, unless they say otherwise.
+    bool is_closing = std::regex_search(response, CONNECTION_CLOSE_RE) ||
+                      (response.compare(0, 8, "HTTP/1.0") == 0 && !std::regex_search(response, CONNECTION_KEEP_ALIVE_RE));
+
+    // 304 and 204 never have a body, whatever the headers say.
+    const bool has_body = code != "304" && code != "204";
+    // Chunked encoding takes precedence over any content length.
+    const bool is_chunked = has_body && std::regex_search(response, CHUNKED_ENCODING_RE);
+    const bool has_length = has_body && !is_chunked && std::regex_search(response, matches, CONTENT_LENGTH_RE);
+    const size_t content_length = has_length ? (size_t) std::stoull(matches[1]) : 0;
+    if (has_body && !is_chunked && !has_length) {
+        // Without either, the body ends where the connection does.
+        is_closing = true;
     }
 
-    if (chunked_encoding) {
-        response += readChunked_();
+    bool is_complete = true;
+    if (!has_body || (has_length && content_length == 0)) {
+        // Nothing to read.
+    } else if (!co_await isHtml_(response, is_chunked)) {
+        fprintf(stderr, "Skipping non-HTML response from %s\n", urlOf_(path).c_str());
+        is_complete = false;
+    } else if (is_chunked) {
+        response += co_await readChunked_(options_.max_body_size, is_complete);
+    } else if (has_length) {
+        response += co_await readLength_(std::min(content_length, options_.max_body_size));
+        is_complete = content_length <= options_.max_body_size;
     } else {
-        response += readLength_(content_length);
+        response += co_await readUntilClose_(options_.max_body_size, is_complete);
+    }
+
+    if (!is_complete) {
+        // What is left of a short body is cheaper to read than a new connection.
+        const size_t received = response.length() - response.find("\r\n\r\n") - 4;
+        if (received > 0) {
+            fprintf(stderr, "Truncated response from %s at %zu bytes\n", urlOf_(path).c_str(), received);
+        }
+        if (has_length && !is_closing && content_length - received <= MAX_DRAIN_SIZE) {
+            co_await readLength_(content_length - received);
+        } else {
+            reset_();
+            is_closing = true;
+        }
     }
 
-    const std::string url = "http://" + hostname_ + path;
-    return WebPage(url, response);
+    is_open_ = !is_closing;
+    co_return WebPage(urlOf_(path), response);
 }
 
-void HttpRequest::set_socket_blocking_(bool blocking) {
-    long flag = fcntl(sock_, F_GETFL, nullptr);
-    if (blocking) {
-        flag &= ~O_NONBLOCK;
-    } else {
-        flag |= O_NONBLOCK;
+Task<std::vector<std::pair<size_t, WebPage>>> HttpRequest::getAll(std::vector<std::string> paths,
+                                                                  std::vector<Validators> validators) {
+    if (!isOpen()) {
+        co_await open();
+    }
+    if (!is_http2_) {
+        fprintf(stderr, "Host does not speak HTTP/2 anymore: %s\n", hostname_.c_str());
+        throw std::string("HTTP/2 not supported.");
+    }
+    // Only trusted again once all the responses are in.
+    is_open_ = false;
+
+    // All requests go out in a single write, each on a new stream.
+    std::unordered_map<uint32_t, Stream> streams;
+    std::string frames;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        ++requests_made_;
+        appendFrame_(frames, FRAME_HEADERS, FLAG_END_HEADERS | FLAG_END_STREAM, next_stream_id_,
+                     constructHttp2Header_(paths[i], validators.empty() ? Validators() : validators[i]));
+        streams[next_stream_id_].index = i;
+        next_stream_id_ += 2;
     }
-    fcntl(sock_, F_SETFL, flag);
+    co_await write_(frames);
+
+    const auto send_time = std::chrono::steady_clock::now();
+
+    std::vector<std::pair<size_t, WebPage>> pages;
+    // A header block may go on in CONTINUATION frames, nothing else may come in between.
+    uint32_t header_stream = 0;
+    bool header_ends_stream = false;
+    std::string header_block;
+
+    while (!streams.empty()) {
+        const Frame frame = co_await readFrame_();
+        std::string reply;
+
+        if (header_stream != 0 && (frame.type != FRAME_CONTINUATION || frame.stream != header_stream)) {
+            fprintf(stderr, "Interrupted HTTP/2 header block from host: %s\n", hostname_.c_str());
+            throw std::string("HTTP/2 protocol error.");
+        }
+
+        const auto stream = streams.find(frame.stream);
+
+        if (frame.type == FRAME_HEADERS || frame.type == FRAME_CONTINUATION || frame.type == FRAME_DATA) {
+            size_t start = 0;
+            size_t padding = 0;
+            if (frame.type != FRAME_CONTINUATION && (frame.flags & FLAG_PADDED)) {
+                padding = frame.payload.empty() ? 0 : (uint8_t) frame.payload[0];
+                start = 1;
+            }
+            if (frame.type == FRAME_HEADERS && (frame.flags & FLAG_PRIORITY)) {
+                start += 5;
+            }
+            if (start + padding > frame.payload.length()) {
+                fprintf(stderr, "Invalid HTTP/2 padding from host: %s\n", hostname_.c_str());
+                throw std::string("HTTP/2 protocol error.");
+            }
+            const std::string content = frame.payload.substr(start, frame.payload.length() - start - padding);
+            // Set when we want no more of the stream, which then ends with what it has.
+            bool is_cut = false;
+
+            if (frame.type == FRAME_DATA) {
+                // Padding counts against the window too.
+                unacknowledged_bytes_ += frame.payload.length();
+                if (stream != streams.end()) {
+                    Stream& response = stream->second;
+                    response.unacknowledged_bytes += frame.payload.length();
+                    if (response.body.empty() && isBinary(content.data(), content.length())) {
+                        fprintf(stderr, "Skipping non-HTML response from %s\n", urlOf_(paths[response.index]).c_str());
+                        is_cut = true;
+                    } else if (response.body.length() + content.length() > options_.max_body_size) {
+                        response.body.append(content, 0, options_.max_body_size - response.body.length());
+                        fprintf(stderr, "Truncated response from %s at %zu bytes\n",
+                                urlOf_(paths[response.index]).c_str(), response.body.length());
+                        is_cut = true;
+                    } else {
+                        response.body += content;
+                    }
+                }
+            } else {
+                if (frame.type == FRAME_HEADERS) {
+                    header_block = content;
+                    header_ends_stream = frame.flags & FLAG_END_STREAM;
+                } else {
+                    header_block += content;
+                }
+                header_stream = frame.stream;
+                if (header_block.length() > options_.max_header_size) {
+                    // Cannot be skipped, the block still has to be decoded to keep the table in sync.
+                    fprintf(stderr, "Response header too large from host: %s\n", hostname_.c_str());
+                    throw std::string("Response header too large.");
+                }
+
+                if (frame.flags & FLAG_END_HEADERS) {
+                    header_stream = 0;
+                    // Every block is decoded, even of streams we gave up on, to keep the table in sync.
+                    Hpack::Headers headers = hpack_decoder_.decode(header_block);
+                    if (stream != streams.end() && stream->second.response_code.empty()) {
+                        const auto status = std::find_if(headers.begin(), headers.end(), [](const Hpack::Header& header) {
+                            return header.first == ":status";
+                        });
+                        // Informational responses come before the real one.
+                        if (status != headers.end() && status->second[0] != '1') {
+                            const auto type = std::find_if(headers.begin(), headers.end(), [](const Hpack::Header& header) {
+                                return header.first == "content-type";
+                            });
+                            if (type != headers.end() && !isHtmlType(type->second.substr(0, type->second.find(';')))) {
+                                fprintf(stderr, "Skipping non-HTML response from %s\n",
+                                        urlOf_(paths[stream->second.index]).c_str());
+                                is_cut = true;
+                            }
+                            stream->second.response_code = status->second;
+                            stream->second.headers = std::move(headers);
+                            recordResponseTime_(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                    std::chrono::steady_clock::now() - send_time));
+                        }
+                    }
+                }
+            }
+
+            // A stream ending with its headers only ends once the whole block is in.
+            const bool ends_stream = frame.type == FRAME_DATA ?
+                                     (frame.flags & FLAG_END_STREAM) : header_stream == 0 && header_ends_stream;
+            if (stream != streams.end() && (ends_stream || is_cut)) {
+                if (stream->second.response_code.empty()) {
+                    fprintf(stderr, "HTTP/2 response without status from host: %s\n", hostname_.c_str());
+                    throw std::string("HTTP/2 protocol error.");
+                }
+                if (!ends_stream) {
+                    // Whatever is already on its way still comes, and is only counted against the connection.
+                    appendFrame_(reply, FRAME_RST_STREAM, 0, frame.stream, std::string("\0\0\0\x8", 4));
+                }
+                pages.emplace_back(stream->second.index, WebPage(urlOf_(paths[stream->second.index]),
+                                                                 stream->second.response_code, stream->second.headers,
+                                                                 stream->second.body));
+                streams.erase(stream);
+            } else if (stream != streams.end() &&
+                       stream->second.unacknowledged_bytes >= HTTP2_STREAM_WINDOW_SIZE / 2) {
+                appendWindowUpdate_(reply, frame.stream, stream->second.unacknowledged_bytes);
+                stream->second.unacknowledged_bytes = 0;
+            }
+
+            if (unacknowledged_bytes_ >= HTTP2_WINDOW_SIZE / 2) {
+                appendWindowUpdate_(reply, 0, unacknowledged_bytes_);
+                unacknowledged_bytes_ = 0;
+            }
+        } else if (frame.type == FRAME_RST_STREAM) {
+            if (stream != streams.end()) {
+                fprintf(stderr, "Stream reset by host: %s\n", hostname_.c_str());
+                streams.erase(stream);
+            }
+        } else if (frame.type == FRAME_SETTINGS) {
+            applySettings_(frame, reply);
+        } else if (frame.type == FRAME_PING) {
+            if (!(frame.flags & FLAG_ACK)) {
+                appendFrame_(reply, FRAME_PING, FLAG_ACK, 0, frame.payload);
+            }
+        } else if (frame.type == FRAME_GOAWAY) {
+            // Streams after the last one the host accepted will never be answered.
+            if (frame.payload.length() < 8) {
+                throw std::string("HTTP/2 protocol error.");
+            }
+            const uint32_t last_stream = (((uint32_t) (uint8_t) frame.payload[0] << 24) |
+                                          ((uint32_t) (uint8_t) frame.payload[1] << 16) |
+                                          ((uint32_t) (uint8_t) frame.payload[2] << 8) |
+                                          (uint32_t) (uint8_t) frame.payload[3]) & 0x7fffffff;
+            is_going_away_ = true;
+            for (auto itr = streams.begin(); itr != streams.end();) {
+                itr = itr->first > last_stream ? streams.erase(itr) : std::next(itr);
+            }
+        } else if (frame.type == FRAME_PUSH_PROMISE) {
+            // Push is turned off in our settings.
+            fprintf(stderr, "Unexpected HTTP/2 push from host: %s\n", hostname_.c_str());
+            throw std::string("HTTP/2 protocol error.");
+        }
+        // Window updates only matter for sending bodies, and priorities and unknown frames can be ignored.
+
+        if (!reply.empty()) {
+            co_await write_(reply);
+        }
+    }
+
+    is_open_ = true;
+    co_return pages;
 }
 
-void HttpRequest::write_(std::string &data) {
-    if (send(sock_, data.c_str(), data.size(), 0) != data.size()) {
-        fprintf(stderr, "Cannot send request to host: %s\n", hostname_.c_str());
-        throw std::string("Cannot send request.");
+Task<void> HttpRequest::startHttp2_() {
+    std::string settings;
+    for (const auto& setting : {std::make_pair(SETTINGS_ENABLE_PUSH, 0u),
+                                std::make_pair(SETTINGS_INITIAL_WINDOW_SIZE, HTTP2_STREAM_WINDOW_SIZE)}) {
+        settings += (char) (setting.first >> 8);
+        settings += (char) setting.first;
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            settings += (char) (setting.second >> shift);
+        }
+    }
+
+    std::string frames = HTTP2_PREFACE;
+    appendFrame_(frames, FRAME_SETTINGS, 0, 0, settings);
+    // Let whole pages of all streams come in without waiting for us to acknowledge them.
+    appendWindowUpdate_(frames, 0, HTTP2_WINDOW_SIZE - 65535);
+    co_await write_(frames);
+
+    // The host speaks first with its settings, which is also how we know it understood us.
+    const Frame frame = co_await readFrame_();
+    if (frame.type != FRAME_SETTINGS || (frame.flags & FLAG_ACK)) {
+        fprintf(stderr, "Host does not speak HTTP/2: %s\n", hostname_.c_str());
+        throw std::string("HTTP/2 not supported.");
     }
+
+    std::string reply;
+    applySettings_(frame, reply);
+    co_await write_(reply);
 }
 
-size_t HttpRequest::read_(size_t length) {
-    ssize_t bytes_read = recv(sock_, buffer_, length, 0);
-    if (bytes_read <= 0) {
-        fprintf(stderr, "Cannot read response from host: %s\n", hostname_.c_str());
-        throw std::string("Cannot read response");
+Task<HttpRequest::Frame> HttpRequest::readFrame_() {
+    const std::string header = co_await readLength_(9);
+    const size_t length = ((size_t) (uint8_t) header[0] << 16) | ((size_t) (uint8_t) header[1] << 8) |
+                          (size_t) (uint8_t) header[2];
+    if (length > HTTP2_MAX_FRAME_SIZE) {
+        // Also what an HTTP/1.1 response looks like.
+        fprintf(stderr, "Invalid HTTP/2 frame from host: %s\n", hostname_.c_str());
+        throw std::string("HTTP/2 protocol error.");
     }
-    return (size_t) bytes_read;
+
+    Frame frame;
+    frame.type = (uint8_t) header[3];
+    frame.flags = (uint8_t) header[4];
+    frame.stream = (((uint32_t) (uint8_t) header[5] << 24) | ((uint32_t) (uint8_t) header[6] << 16) |
+                    ((uint32_t) (uint8_t) header[7] << 8) | (uint32_t) (uint8_t) header[8]) & 0x7fffffff;
+    frame.payload = co_await readLength_(length);
+    co_return frame;
 }
 
-std::string HttpRequest::readHeader_() {
-    std::string header;
+void HttpRequest::applySettings_(const Frame& frame, std::string& reply) {
+    if (frame.flags & FLAG_ACK) {
+        return;
+    }
+
+    for (size_t i = 0; i + 6 <= frame.payload.length(); i += 6) {
+        const uint16_t id = (uint16_t) (((uint8_t) frame.payload[i] << 8) | (uint8_t) frame.payload[i + 1]);
+        uint32_t value = 0;
+        for (size_t j = i + 2; j < i + 6; ++j) {
+            value = (value << 8) | (uint8_t) frame.payload[j];
+        }
+        if (id == SETTINGS_MAX_CONCURRENT_STREAMS) {
+            max_concurrent_streams_ = value;
+        }
+    }
+    appendFrame_(reply, FRAME_SETTINGS, FLAG_ACK, 0, "");
+}
+
+void HttpRequest::appendFrame_(std::string& data, uint8_t type, uint8_t flags, uint32_t stream,
+                               const std::string& payload) {
+    data += (char) (payload.length() >> 16);
+    data += (char) (payload.length() >> 8);
+    data += (char) payload.length();
+    data += (char) type;
+    data += (char) flags;
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        data += (char) (stream >> shift);
+    }
+    data += payload;
+}
+
+void HttpRequest::appendWindowUpdate_(std::string& data, uint32_t stream, uint32_t increment) {
+    std::string payload;
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        payload += (char) (increment >> shift);
+    }
+    appendFrame_(data, FRAME_WINDOW_UPDATE, 0, stream, payload);
+}
+
+Reactor::Clock::time_point HttpRequest::deadline_() const {
+    return Reactor::Clock::now() + timeout_;
+}
+
+Task<void> HttpRequest::send_(const char* data, size_t length) {
+    size_t total_sent = 0;
+    while (total_sent < length) {
+        const ssize_t bytes_sent = co_await reactor_.send(sock_, data + total_sent, length - total_sent, deadline_());
+        if (bytes_sent >= 0) {
+            total_sent += bytes_sent;
+        } else if (bytes_sent == -ETIMEDOUT) {
+            ++timeouts_;
+            fprintf(stderr, "Timed out sending request to host: %s\n", hostname_.c_str());
+            throw std::string("Request timed out.");
+        } else if (bytes_sent == -EPIPE || bytes_sent == -ECONNRESET) {
+            is_closed_by_host_ = true;
+            fprintf(stderr, "Connection closed by host: %s\n", hostname_.c_str());
+            throw std::string("Connection closed.");
+        } else {
+            fprintf(stderr, "Cannot send request to host: %s\n", hostname_.c_str());
+            throw std::string("Cannot send request.");
+        }
+    }
+}
+
+Task<size_t> HttpRequest::receive_(char* buffer, size_t length) {
+    const ssize_t bytes_read = co_await reactor_.recv(sock_, buffer, length, deadline_());
+    if (bytes_read > 0) {
+        bytes_received_ += bytes_read;
+        co_return (size_t) bytes_read;
+    }
+    if (bytes_read == 0 || bytes_read == -ECONNRESET) {
+        // The end of the stream, for the caller to decide whether the response was complete.
+        is_closed_by_host_ = true;
+        co_return 0;
+    }
+    if (bytes_read == -ETIMEDOUT) {
+        ++timeouts_;
+        fprintf(stderr, "Timed out reading response from host: %s\n", hostname_.c_str());
+        throw std::string("Response timed out.");
+    }
+    fprintf(stderr, "Cannot read response from host: %s\n", hostname_.c_str());
+    throw std::string("Cannot read response");
+}
+
+Task<void> HttpRequest::handshake_() {
+    const auto start_time = std::chrono::steady_clock::now();
+
+    ssl_ = tls_->connect(hostname_, origin_);
+    tls_buffer_.reset(new char[buffer_size_]);
+
     while (true) {
-        read_(1);
-        header += buffer_[0];
-        if (header.length() > 4 && header.substr(header.length() - 4) == "\r\n\r\n") {
+        ERR_clear_error();
+        const int result = SSL_do_handshake(ssl_);
+        co_await flushTls_();
+        if (result == 1) {
             break;
         }
+        if (SSL_get_error(ssl_, result) != SSL_ERROR_WANT_READ) {
+            // A rejected certificate leaves nothing in the error queue.
+            const long verify_result = SSL_get_verify_result(ssl_);
+            fprintf(stderr, "TLS handshake with host %s failed: %s\n", hostname_.c_str(),
+                    verify_result != X509_V_OK ? X509_verify_cert_error_string(verify_result)
+                                               : ERR_error_string(ERR_get_error(), nullptr));
+            throw std::string("TLS handshake failed.");
+        }
+        if (!co_await feedTls_()) {
+            fprintf(stderr, "TLS handshake with host %s failed: connection closed\n", hostname_.c_str());
+            throw std::string("TLS handshake failed.");
+        }
     }
-    return header;
+
+    handshake_time_ += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_time);
+    ++handshakes_;
+    resumptions_ += SSL_session_reused(ssl_) == 1;
+
+    const unsigned char* protocol;
+    unsigned int length;
+    SSL_get0_alpn_selected(ssl_, &protocol, &length);
+    is_http2_ = length == 2 && memcmp(protocol, "h2", 2) == 0;
 }
 
-std::string HttpRequest::readChunked_() {
+Task<void> HttpRequest::flushTls_() {
+    BIO* output = SSL_get_wbio(ssl_);
+    while (BIO_ctrl_pending(output) > 0) {
+        const int bytes = BIO_read(output, tls_buffer_.get(), (int) buffer_size_);
+        co_await send_(tls_buffer_.get(), (size_t) bytes);
+    }
+}
+
+Task<bool> HttpRequest::feedTls_() {
+    const size_t bytes = co_await receive_(tls_buffer_.get(), buffer_size_);
+    if (bytes == 0) {
+        co_return false;
+    }
+    BIO_write(SSL_get_rbio(ssl_), tls_buffer_.get(), (int) bytes);
+    co_return true;
+}
+
+Task<void> HttpRequest::write_(const std::string& data) {
+    if (ssl_ == nullptr) {
+        co_await send_(data.c_str(), data.size());
+        co_return;
+    }
+
+    // Encrypting into a memory BIO never has to wait.
+    ERR_clear_error();
+    if (SSL_write(ssl_, data.c_str(), (int) data.size()) <= 0) {
+        fprintf(stderr, "Cannot encrypt request to host: %s\n", hostname_.c_str());
+        throw std::string("Cannot send request.");
+    }
+    co_await flushTls_();
+}
+
+Task<bool> HttpRequest::fill_() {
+    if (is_closed_by_host_) {
+        co_return false;
+    }
+
+    if (ssl_ == nullptr) {
+        buffer_end_ = co_await receive_(buffer_.get(), buffer_size_);
+        buffer_start_ = 0;
+        co_return buffer_end_ > 0;
+    }
+
+    while (true) {
+        ERR_clear_error();
+        const int bytes = SSL_read(ssl_, buffer_.get(), (int) buffer_size_);
+        if (bytes > 0) {
+            buffer_start_ = 0;
+            buffer_end_ = (size_t) bytes;
+            co_return true;
+        }
+
+        // Reading may also have to answer the server, such as when it updates its keys.
+        const int error = SSL_get_error(ssl_, bytes);
+        co_await flushTls_();
+        if (error == SSL_ERROR_ZERO_RETURN) {
+            // The host closed the connection properly.
+            is_closed_by_host_ = true;
+            co_return false;
+        }
+        if (error != SSL_ERROR_WANT_READ) {
+            fprintf(stderr, "Cannot decrypt response from host: %s\n", hostname_.c_str());
+            throw std::string("Cannot read response");
+        }
+        if (!co_await feedTls_()) {
+            co_return false;
+        }
+    }
+}
+
+Task<std::string> HttpRequest::readUntil_(const std::string& delimiter, size_t max_length) {
+    std::string content;
+    while (true) {
+        if (content.length() >= max_length) {
+            fprintf(stderr, "Response header too large from host: %s\n", hostname_.c_str());
+            throw std::string("Response header too large.");
+        }
+        if (buffer_start_ == buffer_end_ && !co_await fill_()) {
+            fprintf(stderr, "Connection closed by host: %s\n", hostname_.c_str());
+            throw std::string("Connection closed.");
+        }
+        content += buffer_[buffer_start_++];
+        if (content.length() >= delimiter.length() &&
+            content.compare(content.length() - delimiter.length(), delimiter.length(), delimiter) == 0) {
+            co_return content;
+        }
+    }
+}
+
+Task<std::string> HttpRequest::readHeader_() {
+    co_return co_await readUntil_("\r\n\r\n", options_.max_header_size);
+}
+
+Task<std::string> HttpRequest::readChunked_(size_t max_length, bool& is_complete) {
     std::string content;
     std::string preamble;
     size_t chunk_size;
     while (true) {
-        preamble = "";
-        while (true) {
-            read_(1);
-            preamble += buffer_[0];
-            if (preamble.length() > 2 && preamble.substr(preamble.length() - 2) == "\r\n") {
-                break;
-            }
-        }
-        chunk_size = (size_t) std::stoi(preamble.substr(0, preamble.length() - 2), nullptr, 16);
+        preamble = co_await readUntil_("\r\n", options_.max_header_size);
+        chunk_size = (size_t) std::stoull(preamble.substr(0, preamble.length() - 2), nullptr, 16);
         if (chunk_size == 0) {
             break;
         }
-        content += readLength_(chunk_size);
-        readLength_(2);
+        if (content.length() + chunk_size > max_length) {
+            content += co_await readLength_(max_length - content.length());
+            is_complete = false;
+            co_return content;
+        }
+        content += co_await readLength_(chunk_size);
+        co_await readLength_(2);
+    }
+
+    // Trailers, if any, up to the empty line ending the message.
+    while (preamble != "\r\n") {
+        preamble = co_await readUntil_("\r\n", options_.max_header_size);
+    }
+    is_complete = true;
+    co_return content;
+}
+
+Task<std::string> HttpRequest::readLength_(size_t length) {
+    std::string content;
+    while (content.length() < length) {
+        if (buffer_start_ == buffer_end_ && !co_await fill_()) {
+            fprintf(stderr, "Connection closed by host: %s\n", hostname_.c_str());
+            throw std::string("Connection closed.");
+        }
+        const size_t bytes = std::min(buffer_end_ - buffer_start_, length - content.length());
+        content.append(buffer_.get() + buffer_start_, bytes);
+        buffer_start_ += bytes;
     }
-    return content;
+    co_return content;
 }
 
-std::string HttpRequest::readLength_(size_t length) {
-    size_t total_read = 0;
-    size_t bytes_read;
+Task<std::string> HttpRequest::readUntilClose_(size_t max_length, bool& is_complete) {
     std::string content;
-    while (total_read < length) {
-        bytes_read = read_(std::min(BUFFER_SIZE, length - total_read));
-        assert(bytes_read > 0);
-        content.append(buffer_, bytes_read);
-        total_read += bytes_read;
+    while (buffer_start_ < buffer_end_ || co_await fill_()) {
+        const size_t bytes = std::min(buffer_end_ - buffer_start_, max_length - content.length());
+        content.append(buffer_.get() + buffer_start_, bytes);
+        buffer_start_ += bytes;
+        if (content.length() == max_length) {
+            is_complete = false;
+            co_return content;
+        }
+    }
+    is_complete = true;
+    co_return content;
+}
+
+Task<bool> HttpRequest::isHtml_(const std::string& header, bool is_chunked) {
+    std::smatch matches;
+    if (std::regex_search(header, matches, CONTENT_TYPE_RE) && !isHtmlType(matches[1])) {
+        co_return false;
+    }
+
+    // Servers get types wrong, so the first bytes of the body get a look too. They are there to be read anyway.
+    if (buffer_start_ == buffer_end_ && !co_await fill_()) {
+        co_return true;
+    }
+    size_t start = buffer_start_;
+    if (is_chunked) {
+        // Past the size of the first chunk, if it came in whole.
+        const char* end = std::search(buffer_.get() + start, buffer_.get() + buffer_end_, "\r\n", "\r\n" + 2);
+        if (end == buffer_.get() + buffer_end_) {
+            co_return true;
+        }
+        start = end - buffer_.get() + 2;
     }
-    return content;
+    co_return !isBinary(buffer_.get() + start, buffer_end_ - start);
 }
 
-std::string HttpRequest::constructGetHeader_(const std::string &path) {
+std::string HttpRequest::constructGetHeader_(const std::string &path, const Validators& validators) {
     std::string header = "GET " + path + " HTTP/1.1\r\n";
     // Host is always required for HTTP/1.1.
-    header += "Host: " + hostname_ + "\r\n";
+    header += "Host: " + authority_ + "\r\n";
     // I only accept text, don't send me gzip or any other media type.
     header += "Accept: text/html,application/xhtml+xml,application/xml\r\n";
     // Blame the school if you are unhappy with this crawler.
-    header += "User-Agent: Mozilla/5.0 (compatible; Homework/0.1; +https://myaces.nus.edu.sg/cors/jsp/report/ModuleDetailedInfo.jsp?acad_y=2016/2017&sem_c=2&mod_c=CS3103)\r\n";
+    header += "User-Agent: " + options_.user_agent + "\r\n";
+    // Only send the page again if it changed since our copy.
+    if (!validators.etag.empty()) {
+        header += "If-None-Match: " + validators.etag + "\r\n";
+    }
+    if (!validators.last_modified.empty()) {
+        header += "If-Modified-Since: " + validators.last_modified + "\r\n";
+    }
     // Use persistent connection.
     header += "Connection: keep-alive\r\n";
     header += "\r\n";
     return header;
 }
 
+std::string HttpRequest::constructHttp2Header_(const std::string& path, const Validators& validators) const {
+    // The same request as over HTTP/1.1, header names are lower case and connection headers are gone.
+    std::string block;
+    Hpack::encode(":method", "GET", block);
+    Hpack::encode(":scheme", tls_ != nullptr ? "https" : "http", block);
+    Hpack::encode(":authority", authority_, block);
+    Hpack::encode(":path", path, block);
+    Hpack::encode("accept", "text/html,application/xhtml+xml,application/xml", block);
+    Hpack::encode("user-agent", options_.user_agent, block);
+    if (!validators.etag.empty()) {
+        Hpack::encode("if-none-match", validators.etag, block);
+    }
+    if (!validators.last_modified.empty()) {
+        Hpack::encode("if-modified-since", validators.last_modified, block);
+    }
+    return block;
+}
+
+std::string HttpRequest::urlOf_(const std::string& path) const {
+    return (tls_ != nullptr ? "https://" : "http://") + hostname_ + ":" + port_ + path;
+}
+
+void HttpRequest::recordResponseTime_(std::chrono::milliseconds response_time) {
+    total_response_time_ += response_time;
+
+    // Follow the response times of this host, with enough headroom for the occasional slow page.
+    latencies_.record(response_time);
+    if (latencies_.count() >= 4) {
+        setTimeout(latencies_.percentile(95) * 4);
+    }
+}
+
+void HttpRequest::setTimeout(std::chrono::milliseconds timeout) {
+    timeout_ = std::max(MIN_TIMEOUT, std::min(options_.max_timeout, timeout));
+}
+
+void HttpRequest::setOptions(const Options& options) {
+    options_ = options;
+    setTimeout(timeout_);
+}
+
+uint32_t HttpRequest::getHandshakeCount() const {
+    return handshakes_;
+}
+
+uint32_t HttpRequest::getResumptionCount() const {
+    return resumptions_;
+}
+
+std::chrono::microseconds HttpRequest::getHandshakeTime() const {
+    return handshake_time_;
+}
+
+bool HttpRequest::isHttp2() const {
+    return is_http2_;
+}
+
+uint32_t HttpRequest::getMaxConcurrentStreams() const {
+    // A host may ask for no streams at all for a while, we still send one at a time.
+    return std::max(1u, std::min(max_concurrent_streams_, MAX_STREAMS));
+}
+
+uint32_t HttpRequest::getTimeoutCount() const {
+    return timeouts_;
+}
+
+const LatencyHistogram& HttpRequest::getLatencies() const {
+    return latencies_;
+}
+
 std::chrono::milliseconds HttpRequest::getAverageResponseTimeMs() {
     if (requests_made_ == 0) {
         return std::chrono::milliseconds(0);
@@ -209,6 +847,49 @@ std::chrono::milliseconds HttpRequest::getAverageResponseTimeMs() {
     return total_response_time_ / requests_made_;
 }
 
+void HttpRequest::close_() {
+    if (ssl_ != nullptr) {
+        // Sessions of connections dropped without a close notify are forgotten, by OpenSSL and by servers that
+        // keep a session cache. The notify is small enough for the socket buffer, so it is sent without waiting.
+        SSL_shutdown(ssl_);
+        BIO* output = SSL_get_wbio(ssl_);
+        char close_notify[256];
+        int bytes;
+        while (sock_ != -1 && (bytes = BIO_read(output, close_notify, sizeof(close_notify))) > 0) {
+            if (send(sock_, close_notify, (size_t) bytes, MSG_DONTWAIT | MSG_NOSIGNAL) != bytes) {
+                break;
+            }
+        }
+        SSL_free(ssl_);
+        ssl_ = nullptr;
+    }
+    if (sock_ != -1) {
+        reactor_.close(sock_);
+        sock_ = -1;
+    }
+
+    // Everything negotiated with the host goes with the connection.
+    is_open_ = false;
+    is_closed_by_host_ = false;
+    connection_requests_ = 0;
+    buffer_start_ = buffer_end_ = 0;
+    is_http2_ = false;
+    is_going_away_ = false;
+    hpack_decoder_ = Hpack::Decoder();
+    next_stream_id_ = 1;
+    max_concurrent_streams_ = 100;
+    unacknowledged_bytes_ = 0;
+}
+
+void HttpRequest::reset_() {
+    // Closing with a zero linger resets the connection, instead of leaving the host to send the rest into the void.
+    if (sock_ != -1) {
+        const linger option = {1, 0};
+        setsockopt(sock_, SOL_SOCKET, SO_LINGER, &option, sizeof(option));
+    }
+    close_();
+}
+
 HttpRequest::~HttpRequest() {
-    close(sock_);
+    close_();
 }
@@ -7,57 +7,287 @@
 
 #include <string>
 #include <chrono>
+#include <memory>
 #include <regex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 #include "WebPage.h"
+#include "Hpack.h"
+#include "LatencyHistogram.h"
+#include "Reactor.h"
+#include "Task.h"
+#include "TlsContext.h"
 
 
 class HttpRequest {
+public:
+    /**
+     * Validators of a copy of a page we already have, to only get the page again if it has changed.
+     */
+    struct Validators {
+        std::string etag;
+        std::string last_modified;
+    };
+
+    /**
+     * How a connection behaves towards its host. The buffer size takes effect on the next connection.
+     */
+    struct Options {
+        // How much of a response we take. Anything beyond is cut off, and the links are taken from what was received.
+        size_t max_header_size = 64 * 1024;
+        size_t max_body_size = 1024 * 1024;
+        size_t buffer_size = 16384;
+        // The timeout adapts to the host, but never above this.
+        std::chrono::milliseconds max_timeout = std::chrono::milliseconds(10000);
+        std::string user_agent = DEFAULT_USER_AGENT;
+    };
+
 private:
+    enum Http2FrameType : uint8_t {
+        FRAME_DATA = 0x0,
+        FRAME_HEADERS = 0x1,
+        FRAME_RST_STREAM = 0x3,
+        FRAME_SETTINGS = 0x4,
+        FRAME_PUSH_PROMISE = 0x5,
+        FRAME_PING = 0x6,
+        FRAME_GOAWAY = 0x7,
+        FRAME_WINDOW_UPDATE = 0x8,
+        FRAME_CONTINUATION = 0x9
+    };
+
+    enum Http2Flag : uint8_t {
+        FLAG_ACK = 0x1,
+        FLAG_END_STREAM = 0x1,
+        FLAG_END_HEADERS = 0x4,
+        FLAG_PADDED = 0x8,
+        FLAG_PRIORITY = 0x20
+    };
+
+    enum Http2Setting : uint16_t {
+        SETTINGS_ENABLE_PUSH = 0x2,
+        SETTINGS_MAX_CONCURRENT_STREAMS = 0x3,
+        SETTINGS_INITIAL_WINDOW_SIZE = 0x4
+    };
+
+    struct Frame {
+        uint8_t type = 0;
+        uint8_t flags = 0;
+        uint32_t stream = 0;
+        std::string payload;
+    };
+
+    /**
+     * A request in flight over HTTP/2.
+     */
+    struct Stream {
+        size_t index;    // Of the path in the batch.
+        std::string response_code;
+        Hpack::Headers headers;
+        std::string body;
+        uint32_t unacknowledged_bytes = 0;    // Received but not yet given back to the flow control window.
+    };
+
     static const std::regex CONTENT_LENGTH_RE;
     static const std::regex CONNECTION_CLOSE_RE;
+    static const std::regex CONNECTION_KEEP_ALIVE_RE;
     static const std::regex CHUNKED_ENCODING_RE;
-    static const size_t BUFFER_SIZE;
+    static const std::regex CONTENT_TYPE_RE;
+    static const size_t MAX_DRAIN_SIZE;
+    static const std::chrono::milliseconds MIN_TIMEOUT;
+    static const std::string DEFAULT_USER_AGENT;
+    static const std::string HTTP2_PREFACE;
+    static const size_t HTTP2_MAX_FRAME_SIZE = 16384;
+    static const uint32_t HTTP2_WINDOW_SIZE;
+    static const uint32_t HTTP2_STREAM_WINDOW_SIZE;
+    static const uint32_t MAX_STREAMS;
 
+    Reactor& reactor_;
     const std::string hostname_;
     const std::string port_;
+    const std::string origin_;
+    const std::string authority_;
+
+    // Encrypted bytes are moved between the socket and OpenSSL through tls_buffer_.
+    TlsContext* const tls_;
+    SSL* ssl_ = nullptr;
+    std::unique_ptr<char[]> tls_buffer_;
+    // Over all connections opened, which is more than one when the host closes them.
+    uint32_t handshakes_ = 0;
+    uint32_t resumptions_ = 0;
+    std::chrono::microseconds handshake_time_ = std::chrono::microseconds(0);
 
-    struct timeval timeout_ = { .tv_sec = 1, .tv_usec = 0 };
-    fd_set fds_;
+    // HTTP/2 is spoken when negotiated over TLS, or right away on plain connections known to support it.
+    const bool http2_prior_knowledge_;
+    bool is_http2_ = false;
+    bool is_going_away_ = false;
+    Hpack::Decoder hpack_decoder_;
+    uint32_t next_stream_id_ = 1;
+    uint32_t max_concurrent_streams_ = 100;
+    uint32_t unacknowledged_bytes_ = 0;
 
+    std::chrono::milliseconds timeout_ = std::chrono::milliseconds(1000);
+    Options options_;
+
+    // A connection is open from the end of open() until a request fails or the host says it will close it.
     int sock_ = -1;
+    bool is_open_ = false;
+    bool is_closed_by_host_ = false;
+    uint32_t connection_requests_ = 0;
+    uint64_t bytes_received_ = 0;
     std::chrono::milliseconds total_response_time_ = std::chrono::milliseconds(0);
     uint32_t requests_made_ = 0;
+    uint32_t timeouts_ = 0;
+    LatencyHistogram latencies_;
 
-    char buffer_[1024];
+    // Received but not yet consumed bytes are buffer_[buffer_start_, buffer_end_).
+    std::unique_ptr<char[]> buffer_;
+    size_t buffer_size_ = 0;
+    size_t buffer_start_ = 0;
+    size_t buffer_end_ = 0;
 
-    void set_socket_blocking_(bool blocking);
-    void write_(std::string &data);
-    size_t read_(size_t length);
-    std::string readHeader_();
-    std::string readChunked_();
-    std::string readLength_(size_t length);
-    std::string constructGetHeader_(const std::string &path);
+    Reactor::Clock::time_point deadline_() const;
+    Task<void> send_(const char* data, size_t length);
+    Task<size_t> receive_(char* buffer, size_t length);
+    Task<void> handshake_();
+    Task<void> flushTls_();
+    Task<bool> feedTls_();
+    Task<void> write_(const std::string& data);
+    Task<bool> fill_();
+    Task<std::string> readUntil_(const std::string& delimiter, size_t max_length);
+    Task<std::string> readHeader_();
+    Task<std::string> readChunked_(size_t max_length, bool& is_complete);
+    Task<std::string> readLength_(size_t length);
+    Task<std::string> readUntilClose_(size_t max_length, bool& is_complete);
+    Task<bool> isHtml_(const std::string& header, bool is_chunked);
+    Task<WebPage> fetch_(const std::string& path, const Validators& validators);
+    void close_();
+    void reset_();
+    std::string constructGetHeader_(const std::string &path, const Validators& validators);
+    std::string constructHttp2Header_(const std::string& path, const Validators& validators) const;
+    std::string urlOf_(const std::string& path) const;
+    void recordResponseTime_(std::chrono::milliseconds response_time);
+    Task<void> startHttp2_();
+    Task<Frame> readFrame_();
+    void applySettings_(const Frame& frame, std::string& reply);
+    static void appendFrame_(std::string& data, uint8_t type, uint8_t flags, uint32_t stream, const std::string& payload);
+    static void appendWindowUpdate_(std::string& data, uint32_t stream, uint32_t increment);
 public:
     /**
      * Construct a Request object to a host.
      *
+     * @param reactor The reactor to wait on for the socket.
      * @param host The host to connect to.
+     * @param port The port to connect to.
+     * @param tls The TLS context to speak HTTPS with, or nullptr for plain HTTP.
+     * @param http2_prior_knowledge Whether to speak HTTP/2 on a plain connection without asking (h2c).
      * @return A new Request object.
      */
-    HttpRequest(const std::string& hostname, const std::string& port);
+    HttpRequest(Reactor& reactor, const std::string& hostname, const std::string& port, TlsContext* tls = nullptr,
+                bool http2_prior_knowledge = false);
+
+    /**
+     * Open the connection to the host, including the TLS handshake for HTTPS and the exchange of settings
+     * for HTTP/2. Opening again drops the current connection and starts a new one.
+     */
+    Task<void> open();
 
     /**
-     * Open the connection to the host.
+     * Gets whether the connection can take another request. It cannot once a request on it failed, the host said
+     * it would close it, or an HTTP/2 host is going away; open() starts a new one.
+     *
+     * @return Whether the connection is open.
      */
-    void open();
+    bool isOpen() const;
 
     /**
-     * Requests a webpage.
+     * Requests a webpage, opening a new connection first if the last one was closed. A request on an idle
+     * connection that the host closed before answering is sent again once on a new connection.
      *
      * @param path The path to GET.
-     * @return
+     * @param validators The validators of our copy of the page, if any. The host answers 304 if it is still current.
+     * @return The response, whatever its status. Redirects are not followed.
+     */
+    Task<WebPage> get(std::string path, Validators validators = Validators());
+
+    /**
+     * Requests several webpages at once over HTTP/2, each on a stream of its own, and waits for all of them.
+     * Pages whose stream the host resets or refuses are left out. Opens a new connection first if the last one
+     * was closed, and throws a string if the host no longer speaks HTTP/2 on it.
+     *
+     * @param paths The paths to GET, at most getMaxConcurrentStreams() of them.
+     * @param validators The validators of our copies of the pages, one for each path, or none at all.
+     * @return The pages received, with the index of their path, in the order they completed.
+     */
+    Task<std::vector<std::pair<size_t, WebPage>>> getAll(std::vector<std::string> paths,
+                                                         std::vector<Validators> validators = {});
+
+    /**
+     * Gets whether the connection speaks HTTP/2, so that getAll() can be used.
+     *
+     * @return Whether the connection speaks HTTP/2.
+     */
+    bool isHttp2() const;
+
+    /**
+     * Gets how many requests may be in flight at once over HTTP/2, as allowed by the host and by us.
+     *
+     * @return The number of concurrent streams.
+     */
+    uint32_t getMaxConcurrentStreams() const;
+
+    /**
+     * Sets the timeout for connecting, sending and receiving. Clamped to a sane range, up to the maximum timeout of
+     * the options.
+     * The timeout also adapts by itself to the response times of the host as requests are made.
+     *
+     * @param timeout The timeout.
+     */
+    void setTimeout(std::chrono::milliseconds timeout);
+
+    /**
+     * Sets how much of a response to take from the host, and how to talk to it. Larger bodies are truncated, and
+     * responses that are not HTML by their Content-Type or first bytes are dropped without reading them. The rest
+     * of such a response is drained when it is short, otherwise the connection or HTTP/2 stream is reset.
+     *
+     * @param options The options.
+     */
+    void setOptions(const Options& options);
+
+    /**
+     * Gets the number of times connecting or reading has timed out.
+     *
+     * @return The number of timeouts.
+     */
+    uint32_t getTimeoutCount() const;
+
+    /**
+     * Gets the response times of all requests made.
+     *
+     * @return The histogram of response times.
+     */
+    const LatencyHistogram& getLatencies() const;
+
+    /**
+     * Gets the number of TLS handshakes completed, one for every connection opened. Zero for plain HTTP.
+     *
+     * @return The number of handshakes.
+     */
+    uint32_t getHandshakeCount() const;
+
+    /**
+     * Gets the number of TLS handshakes that resumed an earlier session instead of doing a full handshake.
+     *
+     * @return The number of resumed handshakes.
+     */
+    uint32_t getResumptionCount() const;
+
+    /**
+     * Gets how long all TLS handshakes took together. Zero for plain HTTP.
+     *
+     * @return The total handshake time.
      */
-    WebPage get(const std::string& path);
+    std::chrono::microseconds getHandshakeTime() const;
 
     /**
      * Gets the average response time for the connection. Calculated using (cumulated response time) / (number of requests made).
@@ -67,7 +297,7 @@ public:
     std::chrono::milliseconds getAverageResponseTimeMs();
 
     /**
-     * Destructs the request object. Close the socket.
+     * Destructs the request object. Close the socket and the TLS connection.
      */
     ~HttpRequest();
 };
@@ -0,0 +1,253 @@
+//
+// Created by Liu Xinan on 19/10/26.
+//
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include "IoUring.h"
+
+
+IoUring::IoUring(unsigned entries, unsigned buffer_count, unsigned buffer_size)
+        : buffer_count_(buffer_count), buffer_size_(buffer_size) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    // Multishot receives can produce many completions per submission, so leave plenty of room for them.
+    params.flags = IORING_SETUP_CLAMP | IORING_SETUP_CQSIZE;
+    params.cq_entries = entries * 4;
+
+    if ((fd_ = (int) syscall(__NR_io_uring_setup, entries, &params)) < 0) {
+        fprintf(stderr, "Cannot set up io_uring: %s\n", strerror(errno));
+        throw std::string("io_uring is not available.");
+    }
+
+    // Waiting with a timeout needs IORING_ENTER_EXT_ARG, and we never want completions dropped.
+    if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_NODROP)) {
+        release_();
+        fprintf(stderr, "Kernel io_uring is too old.\n");
+        throw std::string("io_uring is not available.");
+    }
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED) {
+        sq_ring_ = nullptr;
+        release_();
+        throw std::string("io_uring is not available.");
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        cq_ring_ = sq_ring_;
+    } else {
+        cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+        if (cq_ring_ == MAP_FAILED) {
+            cq_ring_ = nullptr;
+            release_();
+            throw std::string("io_uring is not available.");
+        }
+    }
+
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = (io_uring_sqe*) mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+    if (sqes_ == MAP_FAILED) {
+        sqes_ = nullptr;
+        release_();
+        throw std::string("io_uring is not available.");
+    }
+
+    char* sq = (char*) sq_ring_;
+    sq_head_ = (unsigned*) (sq + params.sq_off.head);
+    sq_tail_ = (unsigned*) (sq + params.sq_off.tail);
+    sq_mask_ = *(unsigned*) (sq + params.sq_off.ring_mask);
+    sq_entries_ = params.sq_entries;
+    sq_local_tail_ = *sq_tail_;
+
+    // Queue entries are always used in ring order, so the indirection array is the identity.
+    unsigned* sq_array = (unsigned*) (sq + params.sq_off.array);
+    for (unsigned i = 0; i < sq_entries_; ++i) {
+        sq_array[i] = i;
+    }
+
+    char* cq = (char*) cq_ring_;
+    cq_head_ = (unsigned*) (cq + params.cq_off.head);
+    cq_tail_ = (unsigned*) (cq + params.cq_off.tail);
+    cq_mask_ = *(unsigned*) (cq + params.cq_off.ring_mask);
+    cqes_ = (io_uring_cqe*) (cq + params.cq_off.cqes);
+
+    // Register a ring of buffers the kernel picks from when data arrives, so idle connections hold no memory.
+    buffer_ring_size_ = buffer_count_ * sizeof(io_uring_buf);
+    buffer_ring_ = (io_uring_buf_ring*) mmap(nullptr, buffer_ring_size_, PROT_READ | PROT_WRITE,
+                                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffer_ring_ == MAP_FAILED) {
+        buffer_ring_ = nullptr;
+        release_();
+        throw std::string("io_uring is not available.");
+    }
+    buffers_ = new char[(size_t) buffer_count_ * buffer_size_];
+
+    io_uring_buf_reg registration;
+    memset(&registration, 0, sizeof(registration));
+    registration.ring_addr = (uint64_t) buffer_ring_;
+    registration.ring_entries = buffer_count_;
+    registration.bgid = BUFFER_GROUP;
+    if (syscall(__NR_io_uring_register, fd_, IORING_REGISTER_PBUF_RING, &registration, 1) < 0) {
+        fprintf(stderr, "Cannot register io_uring buffer ring: %s\n", strerror(errno));
+        release_();
+        throw std::string("io_uring is not available.");
+    }
+
+    for (unsigned i = 0; i < buffer_count_; ++i) {
+        recycle((uint16_t) i);
+    }
+
+    // Kernels before 6.0 take everything above but fail every multishot receive, try one for real.
+    if (!supportsMultishotRecv_()) {
+        release_();
+        fprintf(stderr, "Kernel io_uring has no multishot receive.\n");
+        throw std::string("io_uring is not available.");
+    }
+}
+
+io_uring_sqe* IoUring::getSqe() {
+    reserve(1);
+
+    io_uring_sqe* sqe = &sqes_[sq_local_tail_ & sq_mask_];
+    ++sq_local_tail_;
+    memset(sqe, 0, sizeof(io_uring_sqe));
+    return sqe;
+}
+
+void IoUring::reserve(unsigned count) {
+    if (sq_local_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) + count > sq_entries_) {
+        // The kernel copies entries when they are submitted, so this frees the whole queue.
+        submit();
+    }
+}
+
+void IoUring::flush() {
+    __atomic_store_n(sq_tail_, sq_local_tail_, __ATOMIC_RELEASE);
+}
+
+void IoUring::submit() {
+    flush();
+    enter_(sq_entries_, 0, 0, nullptr, 0);
+}
+
+void IoUring::wait(std::chrono::nanoseconds timeout) {
+    __kernel_timespec timespec;
+    io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    if (timeout.count() >= 0) {
+        timespec.tv_sec = timeout.count() / 1000000000;
+        timespec.tv_nsec = timeout.count() % 1000000000;
+        arg.ts = (uint64_t) &timespec;
+    }
+
+    enter_(sq_entries_, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+}
+
+char* IoUring::buffer(uint16_t id) const {
+    return buffers_ + (size_t) id * buffer_size_;
+}
+
+void IoUring::recycle(uint16_t id) {
+    // Not bufs[], which older headers shift by the size of an empty struct in C++. Entries start at the ring itself.
+    io_uring_buf* entry = (io_uring_buf*) buffer_ring_ + (buffer_tail_ & (buffer_count_ - 1));
+    entry->addr = (uint64_t) buffer(id);
+    entry->len = buffer_size_;
+    entry->bid = id;
+    ++buffer_tail_;
+    __atomic_store_n(&buffer_ring_->tail, buffer_tail_, __ATOMIC_RELEASE);
+}
+
+IoUring::~IoUring() {
+    release_();
+}
+
+int IoUring::enter_(unsigned to_submit, unsigned min_complete, unsigned flags, const void* arg, size_t arg_size) {
+    const long result = syscall(__NR_io_uring_enter, fd_, to_submit, min_complete, flags, arg, arg_size);
+    // Timeouts and signals are expected, anything else means the ring is unusable and will show up as stuck I/O.
+    if (result < 0 && errno != ETIME && errno != EINTR && errno != EBUSY) {
+        fprintf(stderr, "io_uring_enter failed: %s\n", strerror(errno));
+    }
+    return (int) result;
+}
+
+bool IoUring::supportsMultishotRecv_() {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == -1) {
+        return false;
+    }
+    // One byte and then the end of the stream, which a working receive reports as two completions.
+    const char byte = 0;
+    if (write(fds[1], &byte, 1) != 1) {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    close(fds[1]);
+
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fds[0];
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUFFER_GROUP;
+    flush();
+
+    bool received = false;
+    bool finished = false;
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while (!finished && std::chrono::steady_clock::now() < deadline) {
+        wait(std::chrono::milliseconds(100));
+        reap([this, &received, &finished](const io_uring_cqe& cqe) {
+            if (cqe.flags & IORING_CQE_F_BUFFER) {
+                recycle((uint16_t) (cqe.flags >> IORING_CQE_BUFFER_SHIFT));
+            }
+            if (cqe.res > 0 && (cqe.flags & IORING_CQE_F_MORE)) {
+                received = true;
+            }
+            if (!(cqe.flags & IORING_CQE_F_MORE)) {
+                finished = true;
+            }
+        });
+    }
+    close(fds[0]);
+    // A receive still pending is cancelled when the ring is torn down.
+    return received && finished;
+}
+
+void IoUring::release_() {
+    if (fd_ != -1) {
+        close(fd_);
+        fd_ = -1;
+    }
+    if (sqes_ != nullptr) {
+        munmap(sqes_, sqes_size_);
+    }
+    if (cq_ring_ != nullptr && cq_ring_ != sq_ring_) {
+        munmap(cq_ring_, cq_ring_size_);
+    }
+    if (sq_ring_ != nullptr) {
+        munmap(sq_ring_, sq_ring_size_);
+    }
+    if (buffer_ring_ != nullptr) {
+        munmap(buffer_ring_, buffer_ring_size_);
+    }
+    delete[] buffers_;
+    sqes_ = nullptr;
+    cq_ring_ = sq_ring_ = nullptr;
+    buffer_ring_ = nullptr;
+    buffers_ = nullptr;
+}
@@ -0,0 +1,149 @@
+//
+// Created by Liu Xinan on 19/10/26.
+//
+
+#ifndef PARALLELWEBCRAWLER_IOURING_H
+#define PARALLELWEBCRAWLER_IOURING_H
+
+#include <linux/io_uring.h>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+
+/**
+ * A minimal io_uring, set up with raw system calls, with a ring of provided buffers for receiving.
+ *
+ * Submission queue entries are only published to the kernel on flush(), so entries queued by many threads between
+ * two calls to the kernel go in as one batch. Not thread safe, the owner is expected to guard it, except for wait()
+ * which only touches what the kernel owns and may run concurrently with everything else.
+ */
+class IoUring {
+private:
+    int fd_ = -1;
+
+    void* sq_ring_ = nullptr;
+    size_t sq_ring_size_ = 0;
+    void* cq_ring_ = nullptr;
+    size_t cq_ring_size_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    size_t sqes_size_ = 0;
+
+    unsigned* sq_head_;
+    unsigned* sq_tail_;
+    unsigned sq_mask_;
+    unsigned sq_entries_;
+    unsigned sq_local_tail_ = 0;
+
+    unsigned* cq_head_;
+    unsigned* cq_tail_;
+    unsigned cq_mask_;
+    io_uring_cqe* cqes_;
+
+    io_uring_buf_ring* buffer_ring_ = nullptr;
+    size_t buffer_ring_size_ = 0;
+    char* buffers_ = nullptr;
+    unsigned buffer_count_;
+    unsigned buffer_size_;
+    uint16_t buffer_tail_ = 0;
+
+    int enter_(unsigned to_submit, unsigned min_complete, unsigned flags, const void* arg, size_t arg_size);
+
+    /**
+     * Tries a multishot receive with a provided buffer on a socket pair, consuming all its completions.
+     *
+     * @return Whether it received data and kept going until the end of the stream.
+     */
+    bool supportsMultishotRecv_();
+
+    void release_();
+
+public:
+    static const uint16_t BUFFER_GROUP = 0;
+
+    /**
+     * Sets up a ring. Throws a string if the kernel does not support what we need.
+     *
+     * @param entries The size of the submission queue.
+     * @param buffer_count The number of receive buffers, a power of two.
+     * @param buffer_size The size of each receive buffer.
+     * @return A ready ring.
+     */
+    IoUring(unsigned entries, unsigned buffer_count, unsigned buffer_size);
+
+    IoUring(const IoUring&) = delete;
+
+    /**
+     * Gets a free submission queue entry, zeroed. Submits what is queued to make room if the queue is full.
+     *
+     * @return The entry.
+     */
+    io_uring_sqe* getSqe();
+
+    /**
+     * Makes sure the next entries fit in the queue, submitting what is queued if they do not.
+     * Entries linked together must go in with the same submission.
+     *
+     * @param count The number of entries needed.
+     */
+    void reserve(unsigned count);
+
+    /**
+     * Publishes all queued entries to the kernel, without submitting them.
+     */
+    void flush();
+
+    /**
+     * Publishes all queued entries to the kernel and submits them, without waiting.
+     */
+    void submit();
+
+    /**
+     * Submits all published entries, then waits for at least one completion or a timeout.
+     *
+     * @param timeout How long to wait at most, or negative to wait forever.
+     */
+    void wait(std::chrono::nanoseconds timeout);
+
+    /**
+     * Consumes all available completions.
+     *
+     * @param handle Called with each completion.
+     */
+    template <class F>
+    void reap(F&& handle);
+
+    /**
+     * Gets the memory of a provided buffer picked by the kernel.
+     *
+     * @param id The buffer id from the completion flags.
+     * @return The buffer.
+     */
+    char* buffer(uint16_t id) const;
+
+    /**
+     * Gives a provided buffer back to the kernel.
+     *
+     * @param id The buffer id.
+     */
+    void recycle(uint16_t id);
+
+    /**
+     * Tears down the ring. In flight operations are cancelled by the kernel.
+     */
+    ~IoUring();
+};
+
+
+template <class F>
+void IoUring::reap(F&& handle) {
+    unsigned head = *cq_head_;
+    while (head != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+        handle(cqes_[head & cq_mask_]);
+        ++head;
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    }
+}
+
+
+#endif //PARALLELWEBCRAWLER_IOURING_H
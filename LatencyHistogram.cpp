@@ -0,0 +1,44 @@
+//
+// Created by Liu Xinan on 19/10/26.
+//
+
+#include <cmath>
+#include "LatencyHistogram.h"
+
+
+void LatencyHistogram::record(std::chrono::milliseconds latency) {
+    // Bucket i holds samples in [2^(i-1), 2^i) ms, bucket 0 holds samples under 1ms.
+    size_t bucket = 0;
+    for (auto ms = latency.count(); ms > 0 && bucket < NUMBER_OF_BUCKETS - 1; ms >>= 1) {
+        ++bucket;
+    }
+    ++buckets_[bucket];
+    ++count_;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    for (size_t i = 0; i < NUMBER_OF_BUCKETS; ++i) {
+        buckets_[i] += other.buckets_[i];
+    }
+    count_ += other.count_;
+}
+
+std::chrono::milliseconds LatencyHistogram::percentile(double percentile) const {
+    if (count_ == 0) {
+        return std::chrono::milliseconds(0);
+    }
+
+    const auto rank = (uint32_t) std::ceil(count_ * percentile / 100);
+    uint32_t seen = 0;
+    for (size_t i = 0; i < NUMBER_OF_BUCKETS; ++i) {
+        seen += buckets_[i];
+        if (seen >= rank) {
+            return std::chrono::milliseconds(1LL << i);
+        }
+    }
+    return std::chrono::milliseconds(1LL << (NUMBER_OF_BUCKETS - 1));
+}
+
+uint32_t LatencyHistogram::count() const {
+    return count_;
+}
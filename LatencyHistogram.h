@@ -0,0 +1,56 @@
+//
+// Created by Liu Xinan on 19/10/26.
+//
+
+#ifndef PARALLELWEBCRAWLER_LATENCYHISTOGRAM_H
+#define PARALLELWEBCRAWLER_LATENCYHISTOGRAM_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+
+/**
+ * A fixed size histogram of latencies with power of two millisecond buckets.
+ * Cheap enough to keep one per connection and to merge into a global one.
+ */
+class LatencyHistogram {
+private:
+    static const size_t NUMBER_OF_BUCKETS = 24;
+
+    std::array<uint32_t, NUMBER_OF_BUCKETS> buckets_ = {};
+    uint32_t count_ = 0;
+
+public:
+    /**
+     * Records one latency sample.
+     *
+     * @param latency The sample.
+     */
+    void record(std::chrono::milliseconds latency);
+
+    /**
+     * Adds all samples of another histogram into this one.
+     *
+     * @param other The other histogram.
+     */
+    void merge(const LatencyHistogram& other);
+
+    /**
+     * Estimates a percentile. Rounded up to the upper bound of the bucket it falls in.
+     *
+     * @param percentile The percentile in (0, 100].
+     * @return The estimated latency, or 0 if nothing has been recorded.
+     */
+    std::chrono::milliseconds percentile(double percentile) const;
+
+    /**
+     * Gets the number of samples recorded.
+     *
+     * @return The number of samples.
+     */
+    uint32_t count() const;
+};
+
+
+#endif //PARALLELWEBCRAWLER_LATENCYHISTOGRAM_H
@@ -3,6 +3,7 @@
 //
 
 #include <algorithm>
+#include <cctype>
 #include <regex>
 #include <iostream>
 #include "Link.h"
@@ -12,7 +13,9 @@ const std::regex Link::PARTIAL_URL_RE = std::regex("(/?.*)");
 
 Link::Link(const std::string& url, const std::string& referrer_url) {
     std::smatch matches;
-    if (std::regex_match(url, matches, FULL_URL_RE)) {
+    if (parseFullUrl_(url)) {
+        // Most urls are plain absolute ones, which need no regex.
+    } else if (std::regex_match(url, matches, FULL_URL_RE)) {
         protocol_ = matches[1].str();
         host_ = matches[2].str();
         port_ = matches[4].str();
@@ -38,7 +41,7 @@ Link::Link(const std::string& url, const std::string& referrer_url) {
     std::transform(host_.cbegin(), host_.cend(), host_.begin(), ::tolower);
 
     if (port_.empty()) {
-        port_ = "80";
+        port_ = protocol_ == "https" ? "443" : "80";
     }
 
     if (path_.empty()) {
@@ -48,23 +51,67 @@ Link::Link(const std::string& url, const std::string& referrer_url) {
     url_ = protocol_ + "://" + host_ + ":" + port_ + path_;
 }
 
-std::string Link::getProtocol() const {
+bool Link::parseFullUrl_(const std::string& url) {
+    const auto isWord = [](char c) {
+        return std::isalnum((unsigned char) c) || c == '_';
+    };
+    // Like [A-z0-9\-\.], which lets in the few symbols between Z and a as well.
+    const auto isHost = [](char c) {
+        return (c >= 'A' && c <= 'z') || std::isdigit((unsigned char) c) || c == '-' || c == '.';
+    };
+
+    size_t i = 0;
+    while (i < url.length() && isWord(url[i])) {
+        ++i;
+    }
+    if (i == 0 || url.compare(i, 3, "://") != 0) {
+        return false;
+    }
+    const size_t host = i + 3;
+    for (i = host; i < url.length() && isHost(url[i]); ++i) {}
+    if (i == host) {
+        return false;
+    }
+    const size_t host_end = i;
+
+    size_t port = i;
+    if (i < url.length() && url[i] == ':') {
+        for (port = ++i; i < url.length() && std::isdigit((unsigned char) url[i]); ++i) {}
+        if (i == port) {
+            return false;
+        }
+    }
+    const size_t port_end = i;
+
+    // The path goes on to the end, but . does not match line breaks.
+    if (i < url.length() && (url[i] != '/' || url.find_first_of("\r\n", i) != std::string::npos)) {
+        return false;
+    }
+
+    protocol_ = url.substr(0, host - 3);
+    host_ = url.substr(host, host_end - host);
+    port_ = url.substr(port, port_end - port);
+    path_ = url.substr(port_end);
+    return true;
+}
+
+const std::string& Link::getProtocol() const {
     return protocol_;
 }
 
-std::string Link::getHost() const {
+const std::string& Link::getHost() const {
     return host_;
 }
 
-std::string Link::getPort() const {
+const std::string& Link::getPort() const {
     return port_;
 }
 
-std::string Link::getPath() const {
+const std::string& Link::getPath() const {
     return path_;
 }
 
-std::string Link::getUrl() const {
+const std::string& Link::getUrl() const {
     return url_;
 }
 
@@ -20,6 +20,15 @@ private:
     std::string port_;
     std::string path_;
 
+    /**
+     * Takes an absolute url apart the way FULL_URL_RE does, without the regex engine, which dominates the time spent
+     * on parsing links. Leaves anything unusual to the regex.
+     *
+     * @param url The url in string.
+     * @return Whether the url was taken apart.
+     */
+    bool parseFullUrl_(const std::string& url);
+
 public:
     /**
      * Construct a Link object given the url.
@@ -34,35 +43,35 @@ public:
      *
      * @return The protocol in string.
      */
-    std::string getProtocol() const;
+    const std::string& getProtocol() const;
 
     /**
      * Gets the domain of the url.
      *
      * @return The host domain in string.
      */
-    std::string getHost() const;
+    const std::string& getHost() const;
 
     /**
      * Gets the port of the host in the url.
      *
      * @return The port number in string.
      */
-    std::string getPort() const;
+    const std::string& getPort() const;
 
     /**
      * Gets the path of the resource.
      *
      * @return The path part of the url.
      */
-    std::string getPath() const;
+    const std::string& getPath() const;
 
     /**
      * Gets the normalized url.
      *
      * @return The url, normalized.
      */
-    std::string getUrl() const;
+    const std::string& getUrl() const;
 
     /**
      * Gets the base url which is protocol://domain.name/.
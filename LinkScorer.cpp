@@ -0,0 +1,78 @@
+//
+// Created by Liu Xinan on 19/10/26.
+//
+
+#include <algorithm>
+#include <string>
+#include "LinkScorer.h"
+
+
+LinkInfo::LinkInfo(unsigned depth, unsigned in_links, double cash, unsigned redirects)
+        : depth(depth), in_links(in_links), cash(cash), redirects(redirects), score(0),
+          is_deprioritized(false) {}
+
+void LinkInfo::merge(const LinkInfo& other) {
+    depth = std::min(depth, other.depth);
+    redirects = std::min(redirects, other.redirects);
+    in_links += other.in_links;
+    cash += other.cash;
+}
+
+void addToBatch(LinkBatch& batch, const Link& link, const LinkInfo& info) {
+    const auto inserted = batch.emplace(link, info);
+    if (!inserted.second) {
+        inserted.first->second.merge(info);
+    }
+}
+
+double DepthScorer::score(const Link& /*link*/, const LinkInfo& info) const {
+    return 1.0 / (1 + info.depth);
+}
+
+double InLinkScorer::score(const Link& /*link*/, const LinkInfo& info) const {
+    // Saturates quickly, a link referenced by a handful of pages is already considered popular.
+    return info.in_links / (info.in_links + 4.0);
+}
+
+double OpicScorer::score(const Link& /*link*/, const LinkInfo& info) const {
+    return info.cash / (info.cash + 1.0);
+}
+
+double UrlPatternScorer::score(const Link& link, const LinkInfo& /*info*/) const {
+    static const char* const SKIPPED_EXTENSIONS[] = {
+            ".jpg", ".jpeg", ".png", ".gif", ".bmp", ".ico", ".svg", ".css", ".js", ".pdf", ".zip", ".gz",
+            ".tar", ".rar", ".exe", ".mp3", ".mp4", ".avi", ".mov", ".doc", ".docx", ".xls", ".xlsx", ".ppt", ".pptx"
+    };
+
+    const std::string& path = link.getPath();
+    double score = 1.0;
+
+    const size_t query = path.find('?');
+    if (query != std::string::npos) {
+        score -= 0.3;
+    }
+
+    // Only look at the path part for the depth and the extension.
+    std::string resource = path.substr(0, query);
+    std::transform(resource.cbegin(), resource.cend(), resource.begin(), ::tolower);
+
+    const long segments = std::count(resource.cbegin(), resource.cend(), '/');
+    if (segments > 6) {
+        score -= 0.3;
+    }
+
+    if (path.length() > 200) {
+        score -= 0.2;
+    }
+
+    for (const auto extension : SKIPPED_EXTENSIONS) {
+        const std::string suffix(extension);
+        if (resource.length() >= suffix.length() &&
+            resource.compare(resource.length() - suffix.length(), suffix.length(), suffix) == 0) {
+            score -= 0.8;
+            break;
+        }
+    }
+
+    return std::max(score, 0.0);
+}
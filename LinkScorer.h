@@ -0,0 +1,102 @@
+//
+// Created by Liu Xinan on 19/10/26.
+//
+
+#ifndef PARALLELWEBCRAWLER_LINKSCORER_H
+#define PARALLELWEBCRAWLER_LINKSCORER_H
+
+#include <unordered_map>
+#include "Link.h"
+
+
+/**
+ * Crawl statistics we keep for a link that is waiting in the frontier.
+ * Everything here is cheap to merge so that it can be updated incrementally whenever the link is rediscovered.
+ */
+struct LinkInfo {
+    unsigned depth;     // Smallest number of hops from any seed.
+    unsigned in_links;  // Number of times the link has been discovered.
+    double cash;        // OPIC cash received from the pages linking here.
+    unsigned redirects; // Number of redirects followed to get here, zero for a plain link.
+    double score;       // Priority computed by the frontier from the fields above.
+    bool is_deprioritized;  // Whether the frontier found it looking like a crawl trap when first discovered.
+
+    LinkInfo(unsigned depth = 0, unsigned in_links = 0, double cash = 0, unsigned redirects = 0);
+
+    /**
+     * Merges the statistics of another discovery of the same link into this one.
+     *
+     * @param other The other discovery.
+     */
+    void merge(const LinkInfo& other);
+};
+
+/**
+ * A batch of discovered links, with their statistics.
+ */
+typedef std::unordered_map<Link, LinkInfo> LinkBatch;
+
+/**
+ * Adds a discovered link into a batch, merging with the existing entry if the link is already there.
+ *
+ * @param batch The batch to add to.
+ * @param link The discovered link.
+ * @param info Statistics of this discovery.
+ */
+void addToBatch(LinkBatch& batch, const Link& link, const LinkInfo& info);
+
+
+/**
+ * Scores a link for the crawl frontier. Higher is more valuable.
+ * Implementations should return a value in [0, 1], the frontier takes care of weighting.
+ */
+class LinkScorer {
+public:
+    virtual ~LinkScorer() {}
+
+    /**
+     * Scores a link.
+     *
+     * @param link The link to score.
+     * @param info What we know about the link so far.
+     * @return The score in [0, 1].
+     */
+    virtual double score(const Link& link, const LinkInfo& info) const = 0;
+};
+
+/**
+ * Prefers links closer to the seeds.
+ */
+class DepthScorer : public LinkScorer {
+public:
+    double score(const Link& link, const LinkInfo& info) const override;
+};
+
+/**
+ * Prefers links that are referenced by many crawled pages.
+ */
+class InLinkScorer : public LinkScorer {
+public:
+    double score(const Link& link, const LinkInfo& info) const override;
+};
+
+/**
+ * Online Page Importance Computation. Every crawled page splits its cash evenly among its outlinks,
+ * so the accumulated cash of a link is an estimate of its PageRank.
+ */
+class OpicScorer : public LinkScorer {
+public:
+    double score(const Link& link, const LinkInfo& info) const override;
+};
+
+/**
+ * Penalizes urls that look unlikely to be useful html pages: query strings, very deep or long paths
+ * and file extensions of non-html resources.
+ */
+class UrlPatternScorer : public LinkScorer {
+public:
+    double score(const Link& link, const LinkInfo& info) const override;
+};
+
+
+#endif //PARALLELWEBCRAWLER_LINKSCORER_H
@@ -0,0 +1,691 @@
+//
+// Created by Liu Xinan on 19/10/26.
+//
+
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include "Reactor.h"
+
+
+Reactor::Waiter::Waiter(Reactor& reactor, Kind kind, int fd, Clock::time_point deadline, ssize_t timeout_result)
+        : Operation(kind), reactor(reactor), fd(fd), deadline(deadline), result(timeout_result) {}
+
+Reactor::Awaiter::Awaiter(Reactor& reactor, Operation::Kind kind, int fd, Clock::time_point deadline,
+                          ssize_t timeout_result)
+        : waiter_(reactor, kind, fd, deadline, timeout_result) {}
+
+bool Reactor::Awaiter::await_suspend(std::coroutine_handle<> handle) {
+    waiter_.handle = handle;
+    // We may be resumed on another thread before this returns, so nothing may touch the awaiter afterwards.
+    return waiter_.reactor.submit_(waiter_);
+}
+
+Reactor::OperationAwaiter::OperationAwaiter(Reactor& reactor, Operation::Kind kind, int fd, Clock::time_point deadline,
+                                            char* buffer, size_t length,
+                                            const sockaddr* address, socklen_t address_length)
+        : Awaiter(reactor, kind, fd, deadline, -ETIMEDOUT) {
+    waiter_.buffer = buffer;
+    waiter_.length = length;
+    waiter_.address = address;
+    waiter_.address_length = address_length;
+}
+
+Reactor::ResolveAwaiter::ResolveAwaiter(Reactor& reactor, const std::string& hostname, const std::string& port)
+        : reactor_(reactor), hostname_(hostname), port_(port) {}
+
+void Reactor::ResolveAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    std::unique_lock<std::mutex> lock(reactor_.lock_);
+
+    // Never resumed, the coroutine is destroyed together with the reactor.
+    if (reactor_.should_stop_) {
+        return;
+    }
+
+    reactor_.resolvers_.enqueue([this, handle] {
+        addrinfo hints;
+        memset(&hints, 0, sizeof(struct addrinfo));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+
+        error_ = getaddrinfo(hostname_.c_str(), port_.c_str(), &hints, &result_);
+
+        // The awaiter is gone as soon as the coroutine resumes.
+        Reactor& reactor = reactor_;
+        reactor.post_(handle);
+    });
+}
+
+Reactor::AddressList Reactor::ResolveAwaiter::await_resume() {
+    if (error_ != 0) {
+        fprintf(stderr, "Error resolving hostname: %s at port %s\n", hostname_.c_str(), port_.c_str());
+        throw std::string("Hostname resolution failed.");
+    }
+    return AddressList(std::exchange(result_, nullptr), freeaddrinfo);
+}
+
+Reactor::ResolveAwaiter::~ResolveAwaiter() {
+    // Still ours if the coroutine was destroyed before it could resume.
+    if (result_ != nullptr) {
+        freeaddrinfo(result_);
+    }
+}
+
+void Reactor::Job::FinalAwaiter::await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+    Reactor& reactor = handle.promise().reactor;
+
+    {  // Acquire lock.
+        std::unique_lock<std::mutex> lock(reactor.lock_);
+
+        reactor.jobs_.erase(handle.address());
+    }  // Release lock.
+
+    handle.destroy();
+}
+
+Reactor::Reactor(ThreadPool& pool, Backend backend, size_t number_of_resolvers)
+        : pool_(pool), resolvers_(number_of_resolvers) {
+    if (backend == Backend::IO_URING) {
+        try {
+            ring_.reset(new IoUring(RING_ENTRIES, RING_BUFFER_COUNT, RING_BUFFER_SIZE));
+        } catch (const std::string& e) {
+            fprintf(stderr, "Falling back to epoll: %s\n", e.c_str());
+        }
+    }
+
+    if (ring_ != nullptr) {
+        // Read by the ring itself, so it may block.
+        if ((wakeup_fd_ = eventfd(0, EFD_CLOEXEC)) == -1) {
+            fprintf(stderr, "Cannot create event loop: %s\n", strerror(errno));
+            throw std::string("Cannot create event loop.");
+        }
+
+        loop_ = std::thread([this] { loopIoUring_(); });
+        return;
+    }
+
+    if ((epoll_fd_ = epoll_create1(EPOLL_CLOEXEC)) == -1 ||
+        (wakeup_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1) {
+        fprintf(stderr, "Cannot create event loop: %s\n", strerror(errno));
+        throw std::string("Cannot create event loop.");
+    }
+
+    epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = wakeup_fd_;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wakeup_fd_, &event);
+
+    loop_ = std::thread([this] { loopEpoll_(); });
+}
+
+Reactor::Backend Reactor::getBackend() const {
+    return ring_ != nullptr ? Backend::IO_URING : Backend::EPOLL;
+}
+
+void Reactor::spawn(Task<void> task) {
+    const Job job = run_(std::move(task));
+
+    {  // Acquire lock.
+        std::unique_lock<std::mutex> lock(lock_);
+
+        jobs_.insert(job.handle.address());
+    }  // Release lock.
+
+    post_(job.handle);
+}
+
+Reactor::IoAwaiter Reactor::readable(int fd, Clock::time_point deadline) {
+    return IoAwaiter(*this, Operation::READABLE, fd, deadline, 0);
+}
+
+Reactor::IoAwaiter Reactor::writable(int fd, Clock::time_point deadline) {
+    return IoAwaiter(*this, Operation::WRITABLE, fd, deadline, 0);
+}
+
+Reactor::IoAwaiter Reactor::sleepUntil(Clock::time_point time_point) {
+    return IoAwaiter(*this, Operation::SLEEP, -1, time_point, 0);
+}
+
+Reactor::IoAwaiter Reactor::sleepFor(Clock::duration duration) {
+    return sleepUntil(Clock::now() + duration);
+}
+
+Reactor::ResolveAwaiter Reactor::resolve(const std::string& hostname, const std::string& port) {
+    return ResolveAwaiter(*this, hostname, port);
+}
+
+Task<ssize_t> Reactor::connect(int fd, const sockaddr* address, socklen_t address_length, Clock::time_point deadline) {
+    if (ring_ != nullptr) {
+        co_return co_await OperationAwaiter(*this, Operation::CONNECT, fd, deadline,
+                                            nullptr, 0, address, address_length);
+    }
+
+    if (::connect(fd, address, address_length) == 0) {
+        co_return 0;
+    }
+
+    // For a non-blocking socket, connect() returns immediately and sets errno to EINPROGRESS.
+    if (errno != EINPROGRESS) {
+        co_return -errno;
+    }
+    if (!co_await writable(fd, deadline)) {
+        co_return -ETIMEDOUT;
+    }
+
+    int error;
+    socklen_t error_len = sizeof(error);
+    // A failed socket is also writable. So we need to check the socket options.
+    if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &error_len) == -1) {
+        co_return -errno;
+    }
+    co_return -error;
+}
+
+Task<ssize_t> Reactor::send(int fd, const char* data, size_t length, Clock::time_point deadline) {
+    if (ring_ != nullptr) {
+        co_return co_await OperationAwaiter(*this, Operation::SEND, fd, deadline,
+                                            const_cast<char*>(data), length, nullptr, 0);
+    }
+
+    while (true) {
+        const ssize_t bytes_sent = ::send(fd, data, length, MSG_NOSIGNAL);
+        if (bytes_sent >= 0) {
+            co_return bytes_sent;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            co_return -errno;
+        }
+        if (!co_await writable(fd, deadline)) {
+            co_return -ETIMEDOUT;
+        }
+    }
+}
+
+Task<ssize_t> Reactor::recv(int fd, char* buffer, size_t length, Clock::time_point deadline) {
+    if (ring_ != nullptr) {
+        co_return co_await OperationAwaiter(*this, Operation::RECV, fd, deadline, buffer, length, nullptr, 0);
+    }
+
+    while (true) {
+        const ssize_t bytes_read = ::recv(fd, buffer, length, 0);
+        if (bytes_read >= 0) {
+            co_return bytes_read;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            co_return -errno;
+        }
+        if (!co_await readable(fd, deadline)) {
+            co_return -ETIMEDOUT;
+        }
+    }
+}
+
+void Reactor::close(int fd) {
+    if (ring_ != nullptr) {
+        std::unique_lock<std::mutex> lock(lock_);
+
+        const auto found = streams_.find(fd);
+        if (found != streams_.end()) {
+            Stream* stream = found->second;
+            // The fd may be reused as soon as it is closed, even if the stream is still winding down.
+            streams_.erase(found);
+            starved_streams_.erase(stream);
+
+            if (!stream->armed) {
+                releaseStream_(*stream);
+            } else {
+                // The receive holds its own reference to the socket, so it has to be cancelled. Freed on its last
+                // completion. When stopping, the event loop cancels everything by itself.
+                stream->closed = true;
+                if (!should_stop_) {
+                    io_uring_sqe* sqe = getSqe_(IGNORED);
+                    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+                    sqe->addr = (uint64_t) stream;
+                    wakeup_();
+                }
+            }
+        }
+    }
+
+    ::close(fd);
+}
+
+void Reactor::stop() {
+    {  // Acquire lock.
+        std::unique_lock<std::mutex> lock(lock_);
+
+        should_stop_ = true;
+        wakeup_();
+    }  // Release lock.
+
+    if (loop_.joinable()) {
+        loop_.join();
+    }
+    resolvers_.stop();
+}
+
+Reactor::~Reactor() {
+    stop();
+
+    // Whatever is left is suspended for good. Destroying the outermost frames destroys everything they await.
+    for (const auto job : jobs_) {
+        std::coroutine_handle<>::from_address(job).destroy();
+    }
+
+    // The event loop has reaped every completion, so nothing is armed anymore.
+    for (const auto& stream : streams_) {
+        releaseStream_(*stream.second);
+    }
+    streams_.clear();
+    ring_.reset();
+
+    ::close(wakeup_fd_);
+    if (epoll_fd_ != -1) {
+        ::close(epoll_fd_);
+    }
+}
+
+Reactor::Job Reactor::run_(Task<void> task) {
+    try {
+        co_await task;
+    } catch (const std::string& e) {
+        fprintf(stderr, "Job failed: %s\n", e.c_str());
+    } catch (const std::exception& e) {
+        fprintf(stderr, "Job failed: %s\n", e.what());
+    }
+}
+
+void Reactor::loopEpoll_() {
+    static const int MAX_EVENTS = 64;
+
+    std::unique_lock<std::mutex> lock(lock_);
+
+    while (!should_stop_) {
+        int timeout = -1;
+        if (!timers_.empty()) {
+            // Round up, waking up early would only make us spin.
+            const auto wait = std::chrono::ceil<std::chrono::milliseconds>(timers_.begin()->first - Clock::now());
+            timeout = (int) std::max(wait.count(), (std::chrono::milliseconds::rep) 0);
+        }
+
+        is_sleeping_ = true;
+        lock.unlock();
+
+        epoll_event events[MAX_EVENTS];
+        const int number_of_events = epoll_wait(epoll_fd_, events, MAX_EVENTS, timeout);
+
+        lock.lock();
+        is_sleeping_ = false;
+
+        for (int i = 0; i < number_of_events; ++i) {
+            const int fd = events[i].data.fd;
+            if (fd == wakeup_fd_) {
+                uint64_t value;
+                while (read(wakeup_fd_, &value, sizeof(value)) > 0);
+                continue;
+            }
+
+            // The waiter may have timed out in the meantime.
+            const auto found = io_waiters_.find(fd);
+            if (found != io_waiters_.end()) {
+                found->second->result = 1;
+                complete_(*found->second);
+            }
+        }
+
+        expireTimers_();
+    }
+}
+
+void Reactor::loopIoUring_() {
+    static const std::chrono::milliseconds DRAIN_TIMEOUT = std::chrono::milliseconds(100);
+
+    std::unique_lock<std::mutex> lock(lock_);
+
+    armWakeup_();
+
+    bool is_draining = false;
+    size_t number_of_completions = 0;
+    while (true) {
+        std::chrono::nanoseconds timeout(-1);
+        if (should_stop_) {
+            // Nothing may be left in flight once the ring and the buffers are gone, so cancel everything and wait.
+            if (in_flight_ == 0) {
+                break;
+            }
+            if (!is_draining || number_of_completions == 0) {
+                io_uring_sqe* sqe = getSqe_(IGNORED);
+                sqe->opcode = IORING_OP_ASYNC_CANCEL;
+                sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY | IORING_ASYNC_CANCEL_ALL;
+                is_draining = true;
+            }
+            timeout = DRAIN_TIMEOUT;
+        } else if (!timers_.empty()) {
+            timeout = std::max(std::chrono::nanoseconds(timers_.begin()->first - Clock::now()),
+                               std::chrono::nanoseconds(0));
+        }
+
+        // Everything queued since the last wait goes in with this one.
+        ring_->flush();
+        is_sleeping_ = true;
+        lock.unlock();
+
+        ring_->wait(timeout);
+
+        lock.lock();
+        is_sleeping_ = false;
+
+        number_of_completions = 0;
+        ring_->reap([this, &number_of_completions](const io_uring_cqe& cqe) {
+            ++number_of_completions;
+            handleCompletion_(cqe);
+        });
+
+        expireTimers_();
+
+        // Streams that ran out of buffers get another go once some have been consumed.
+        if (!should_stop_ && free_buffers_ > 0) {
+            for (const auto stream : starved_streams_) {
+                armStream_(*stream);
+            }
+            starved_streams_.clear();
+        }
+    }
+}
+
+void Reactor::expireTimers_() {
+    const auto now = Clock::now();
+    while (!timers_.empty() && timers_.begin()->first <= now) {
+        complete_(*timers_.begin()->second);
+    }
+}
+
+bool Reactor::submit_(Waiter& waiter) {
+    std::unique_lock<std::mutex> lock(lock_);
+
+    // Never resumed, the coroutine is destroyed together with the reactor.
+    if (should_stop_) {
+        return true;
+    }
+
+    if (ring_ != nullptr) {
+        return submitIoUring_(waiter);
+    }
+    submitEpoll_(waiter);
+    return true;
+}
+
+void Reactor::submitEpoll_(Waiter& waiter) {
+    addTimer_(waiter);
+
+    if (waiter.fd != -1) {
+        io_waiters_[waiter.fd] = &waiter;
+
+        epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = waiter.kind == Operation::READABLE ? EPOLLIN : EPOLLOUT;
+        event.data.fd = waiter.fd;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, waiter.fd, &event) == -1) {
+            // Let the caller find out what is wrong with the socket by itself.
+            waiter.result = 1;
+            complete_(waiter);
+        }
+    }
+}
+
+bool Reactor::submitIoUring_(Waiter& waiter) {
+    if (waiter.kind == Operation::SLEEP) {
+        addTimer_(waiter);
+        return true;
+    }
+
+    if (waiter.kind == Operation::RECV) {
+        Stream*& stream = streams_[waiter.fd];
+        if (stream == nullptr) {
+            stream = new Stream(waiter.fd);
+        }
+
+        // Already received, no need to wait.
+        if (!stream->chunks.empty()) {
+            deliver_(*stream, waiter);
+            return false;
+        }
+
+        stream->waiter = &waiter;
+        waiter.stream = stream;
+        addTimer_(waiter);
+        if (!stream->armed && starved_streams_.count(stream) == 0) {
+            armStream_(*stream);
+        }
+        return true;
+    }
+
+    // The operation and its timeout must go in with the same submission.
+    ring_->reserve(2);
+
+    io_uring_sqe* sqe = getSqe_((uint64_t) &waiter);
+    sqe->fd = waiter.fd;
+    switch (waiter.kind) {
+        case Operation::READABLE:
+            sqe->opcode = IORING_OP_POLL_ADD;
+            sqe->poll32_events = POLLIN;
+            break;
+        case Operation::WRITABLE:
+            sqe->opcode = IORING_OP_POLL_ADD;
+            sqe->poll32_events = POLLOUT;
+            break;
+        case Operation::CONNECT:
+            sqe->opcode = IORING_OP_CONNECT;
+            sqe->addr = (uint64_t) waiter.address;
+            sqe->off = waiter.address_length;
+            break;
+        default:
+            sqe->opcode = IORING_OP_SEND;
+            sqe->addr = (uint64_t) waiter.buffer;
+            sqe->len = (uint32_t) waiter.length;
+            sqe->msg_flags = MSG_NOSIGNAL;
+            break;
+    }
+    sqe->flags = IOSQE_IO_LINK;
+
+    // The steady clock is the monotonic clock, which is what the kernel times out against.
+    const auto deadline = std::chrono::duration_cast<std::chrono::nanoseconds>(waiter.deadline.time_since_epoch());
+    waiter.timeout.tv_sec = deadline.count() / 1000000000;
+    waiter.timeout.tv_nsec = deadline.count() % 1000000000;
+
+    io_uring_sqe* timeout = getSqe_(IGNORED);
+    timeout->opcode = IORING_OP_LINK_TIMEOUT;
+    timeout->addr = (uint64_t) &waiter.timeout;
+    timeout->len = 1;
+    timeout->timeout_flags = IORING_TIMEOUT_ABS;
+
+    wakeup_();
+    return true;
+}
+
+void Reactor::addTimer_(Waiter& waiter) {
+    waiter.timer = timers_.emplace(waiter.deadline, &waiter);
+    waiter.has_timer = true;
+
+    // The event loop may be sleeping past our deadline.
+    if (waiter.timer == timers_.begin()) {
+        wakeup_();
+    }
+}
+
+io_uring_sqe* Reactor::getSqe_(uint64_t user_data) {
+    io_uring_sqe* sqe = ring_->getSqe();
+    sqe->user_data = user_data;
+    ++in_flight_;
+    return sqe;
+}
+
+void Reactor::armWakeup_() {
+    io_uring_sqe* sqe = getSqe_(WAKEUP);
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = wakeup_fd_;
+    sqe->addr = (uint64_t) &wakeup_value_;
+    sqe->len = sizeof(wakeup_value_);
+    sqe->off = (uint64_t) -1;
+}
+
+void Reactor::armStream_(Stream& stream) {
+    // One receive for the whole life of the connection, taking a buffer from the ring whenever data arrives.
+    io_uring_sqe* sqe = getSqe_((uint64_t) &stream);
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = stream.fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = IoUring::BUFFER_GROUP;
+    stream.armed = true;
+
+    wakeup_();
+}
+
+void Reactor::handleCompletion_(const io_uring_cqe& cqe) {
+    if (!(cqe.flags & IORING_CQE_F_MORE)) {
+        --in_flight_;
+    }
+
+    if (cqe.user_data == IGNORED) {
+        return;
+    }
+    if (cqe.user_data == WAKEUP) {
+        if (!should_stop_) {
+            armWakeup_();
+        }
+        return;
+    }
+
+    Operation* operation = (Operation*) cqe.user_data;
+    if (operation->kind == Operation::STREAM) {
+        handleStreamCompletion_(*static_cast<Stream*>(operation), cqe);
+        return;
+    }
+
+    // Cancelled by the linked timeout, so it keeps its timeout result.
+    Waiter& waiter = *static_cast<Waiter*>(operation);
+    if (cqe.res != -ECANCELED) {
+        waiter.result = cqe.res;
+    }
+    complete_(waiter);
+}
+
+void Reactor::handleStreamCompletion_(Stream& stream, const io_uring_cqe& cqe) {
+    if (!(cqe.flags & IORING_CQE_F_MORE)) {
+        stream.armed = false;
+    }
+
+    if (cqe.flags & IORING_CQE_F_BUFFER) {
+        --free_buffers_;
+        const uint16_t buffer_id = (uint16_t) (cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+        if (cqe.res > 0 && !stream.closed) {
+            stream.chunks.push_back(Chunk{cqe.res, buffer_id, 0});
+        } else {
+            recycle_(buffer_id);
+        }
+    }
+
+    if (stream.closed) {
+        if (!stream.armed) {
+            releaseStream_(stream);
+        }
+        return;
+    }
+
+    if (cqe.res == -ENOBUFS) {
+        // All buffers are taken. The data waits in the socket until some are given back.
+        starved_streams_.insert(&stream);
+    } else if (cqe.res <= 0) {
+        // The end of the stream, kept for whoever reads next.
+        stream.chunks.push_back(Chunk{cqe.res, 0, 0});
+    }
+
+    if (stream.waiter != nullptr && !stream.chunks.empty()) {
+        Waiter& waiter = *stream.waiter;
+        deliver_(stream, waiter);
+        complete_(waiter);
+    }
+}
+
+void Reactor::deliver_(Stream& stream, Waiter& waiter) {
+    if (stream.chunks.front().result <= 0) {
+        waiter.result = stream.chunks.front().result;
+        return;
+    }
+
+    size_t bytes = 0;
+    while (bytes < waiter.length && !stream.chunks.empty() && stream.chunks.front().result > 0) {
+        Chunk& chunk = stream.chunks.front();
+        const size_t length = std::min(waiter.length - bytes, (size_t) chunk.result - chunk.offset);
+        memcpy(waiter.buffer + bytes, ring_->buffer(chunk.buffer_id) + chunk.offset, length);
+        bytes += length;
+        chunk.offset += (uint32_t) length;
+
+        if (chunk.offset == (uint32_t) chunk.result) {
+            recycle_(chunk.buffer_id);
+            stream.chunks.pop_front();
+        }
+    }
+    waiter.result = (ssize_t) bytes;
+}
+
+void Reactor::releaseStream_(Stream& stream) {
+    for (const auto& chunk : stream.chunks) {
+        if (chunk.result > 0) {
+            recycle_(chunk.buffer_id);
+        }
+    }
+    starved_streams_.erase(&stream);
+    delete &stream;
+}
+
+void Reactor::recycle_(uint16_t buffer_id) {
+    ring_->recycle(buffer_id);
+    ++free_buffers_;
+}
+
+void Reactor::complete_(Waiter& waiter) {
+    if (waiter.has_timer) {
+        timers_.erase(waiter.timer);
+        waiter.has_timer = false;
+    }
+    if (waiter.stream != nullptr) {
+        waiter.stream->waiter = nullptr;
+        waiter.stream = nullptr;
+    }
+    if (ring_ == nullptr && waiter.fd != -1) {
+        io_waiters_.erase(waiter.fd);
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, waiter.fd, nullptr);
+    }
+
+    // The waiter is destroyed as soon as the coroutine resumes.
+    const auto handle = waiter.handle;
+    if (!should_stop_) {
+        pool_.enqueue([handle] { handle.resume(); });
+    }
+}
+
+void Reactor::post_(std::coroutine_handle<> handle) {
+    std::unique_lock<std::mutex> lock(lock_);
+
+    if (!should_stop_) {
+        pool_.enqueue([handle] { handle.resume(); });
+    }
+}
+
+void Reactor::wakeup_() {
+    // Once woken up, the event loop picks up everything queued until it goes back to sleep.
+    if (!is_sleeping_) {
+        return;
+    }
+    is_sleeping_ = false;
+
+    const uint64_t value = 1;
+    write(wakeup_fd_, &value, sizeof(value));
+}
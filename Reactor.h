@@ -0,0 +1,367 @@
+//
+// Created by Liu Xinan on 19/10/26.
+//
+
+#ifndef PARALLELWEBCRAWLER_REACTOR_H
+#define PARALLELWEBCRAWLER_REACTOR_H
+
+#include <linux/time_types.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <chrono>
+#include <coroutine>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include "IoUring.h"
+#include "Task.h"
+#include "ThreadPool.h"
+
+
+/**
+ * An event loop that lets coroutines wait for sockets, timers and name resolution without holding a thread.
+ *
+ * A single thread waits for all registered sockets and timers. Whenever something a coroutine waits for
+ * happens, the coroutine is resumed on the thread pool, so the crawl logic itself still runs in parallel.
+ *
+ * There are two backends. With epoll, sockets are non-blocking and operations are retried when the socket becomes
+ * ready. With io_uring, connect, send and receive are submitted to the kernel in batches: entries queued while the
+ * event loop is busy go in with its next wait, and each connection has one multishot receive feeding it from a
+ * shared ring of provided buffers. io_uring is used when the kernel supports it, with epoll as the fallback.
+ */
+class Reactor {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    /**
+     * Owns a list of resolved addresses.
+     */
+    typedef std::unique_ptr<addrinfo, void (*)(addrinfo*)> AddressList;
+
+    enum class Backend {
+        EPOLL,
+        IO_URING
+    };
+
+private:
+    static const unsigned RING_ENTRIES = 4096;
+    static const unsigned RING_BUFFER_COUNT = 1024;
+    static const unsigned RING_BUFFER_SIZE = 16384;
+
+    // user_data of completions we do not track.
+    static const uint64_t IGNORED = 0;
+    static const uint64_t WAKEUP = 1;
+
+    struct Operation {
+        enum Kind {
+            SLEEP,
+            READABLE,
+            WRITABLE,
+            CONNECT,
+            SEND,
+            RECV,
+            STREAM
+        };
+
+        const Kind kind;
+
+        Operation(Kind kind) : kind(kind) {}
+    };
+
+    struct Stream;
+
+    /**
+     * A coroutine waiting on the reactor. Lives in the frame of the waiting coroutine.
+     */
+    struct Waiter : Operation {
+        Reactor& reactor;
+        const int fd;
+        const Clock::time_point deadline;
+        std::coroutine_handle<> handle;
+
+        // Operation arguments.
+        char* buffer = nullptr;
+        size_t length = 0;
+        const sockaddr* address = nullptr;
+        socklen_t address_length = 0;
+
+        // Set to what the operation resumes with, starting with what it resumes with on timeout.
+        ssize_t result;
+
+        bool has_timer = false;
+        std::multimap<Clock::time_point, Waiter*>::iterator timer;
+        Stream* stream = nullptr;
+        __kernel_timespec timeout;
+
+        Waiter(Reactor& reactor, Kind kind, int fd, Clock::time_point deadline, ssize_t timeout_result);
+    };
+
+    /**
+     * A received chunk, or the end of a stream if the result is not positive.
+     */
+    struct Chunk {
+        int result;
+        uint16_t buffer_id;
+        uint32_t offset;
+    };
+
+    /**
+     * The multishot receive of a socket, with data received before anyone asked for it.
+     */
+    struct Stream : Operation {
+        const int fd;
+        bool armed = false;
+        bool closed = false;
+        std::deque<Chunk> chunks;
+        Waiter* waiter = nullptr;
+
+        Stream(int fd) : Operation(STREAM), fd(fd) {}
+    };
+
+public:
+    /**
+     * Awaits a socket, a deadline or an operation.
+     */
+    class Awaiter {
+    protected:
+        Waiter waiter_;
+    public:
+        Awaiter(Reactor& reactor, Operation::Kind kind, int fd, Clock::time_point deadline, ssize_t timeout_result);
+        bool await_ready() const noexcept { return false; }
+        bool await_suspend(std::coroutine_handle<> handle);
+    };
+
+    /**
+     * Resumes with true if the socket is ready, false on timeout.
+     */
+    class IoAwaiter : public Awaiter {
+    public:
+        using Awaiter::Awaiter;
+        bool await_resume() const noexcept { return waiter_.result > 0; }
+    };
+
+    /**
+     * Resumes with the result of an operation, negative errno on failure and -ETIMEDOUT on timeout.
+     */
+    class OperationAwaiter : public Awaiter {
+    public:
+        OperationAwaiter(Reactor& reactor, Operation::Kind kind, int fd, Clock::time_point deadline,
+                         char* buffer, size_t length, const sockaddr* address, socklen_t address_length);
+        ssize_t await_resume() const noexcept { return waiter_.result; }
+    };
+
+    /**
+     * Awaits name resolution, done on a separate pool of resolver threads. Throws a string if it fails.
+     */
+    class ResolveAwaiter {
+    private:
+        Reactor& reactor_;
+        const std::string hostname_;
+        const std::string port_;
+        addrinfo* result_ = nullptr;
+        int error_ = 0;
+    public:
+        ResolveAwaiter(Reactor& reactor, const std::string& hostname, const std::string& port);
+        ResolveAwaiter(const ResolveAwaiter&) = delete;
+        ~ResolveAwaiter();
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle);
+        AddressList await_resume();
+    };
+
+    /**
+     * A detached coroutine running a spawned task. Destroys itself when done.
+     */
+    struct Job {
+        struct promise_type;
+
+        struct FinalAwaiter {
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<promise_type> handle) noexcept;
+            void await_resume() const noexcept {}
+        };
+
+        struct promise_type {
+            Reactor& reactor;
+
+            promise_type(Reactor& reactor, Task<void>&) : reactor(reactor) {}
+            Job get_return_object() { return Job{std::coroutine_handle<promise_type>::from_promise(*this)}; }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            FinalAwaiter final_suspend() noexcept { return {}; }
+            void unhandled_exception() noexcept {}
+            void return_void() {}
+        };
+
+        std::coroutine_handle<promise_type> handle;
+    };
+
+private:
+    ThreadPool& pool_;
+    ThreadPool resolvers_;
+
+    std::unique_ptr<IoUring> ring_;
+    int epoll_fd_ = -1;
+    int wakeup_fd_ = -1;
+    uint64_t wakeup_value_ = 0;
+    std::thread loop_;
+    bool is_sleeping_ = false;
+    // Submitted io_uring operations whose last completion has not been reaped yet.
+    size_t in_flight_ = 0;
+    size_t free_buffers_ = RING_BUFFER_COUNT;
+
+    std::unordered_map<int, Waiter*> io_waiters_;
+    std::multimap<Clock::time_point, Waiter*> timers_;
+    std::unordered_map<int, Stream*> streams_;
+    std::unordered_set<Stream*> starved_streams_;
+    std::unordered_set<void*> jobs_;
+    bool should_stop_ = false;
+
+    std::mutex lock_;
+
+    Job run_(Task<void> task);
+    void loopEpoll_();
+    void loopIoUring_();
+    void expireTimers_();
+    bool submit_(Waiter& waiter);
+    void submitEpoll_(Waiter& waiter);
+    bool submitIoUring_(Waiter& waiter);
+    void addTimer_(Waiter& waiter);
+    io_uring_sqe* getSqe_(uint64_t user_data);
+    void armWakeup_();
+    void armStream_(Stream& stream);
+    void handleCompletion_(const io_uring_cqe& cqe);
+    void handleStreamCompletion_(Stream& stream, const io_uring_cqe& cqe);
+    void deliver_(Stream& stream, Waiter& waiter);
+    void releaseStream_(Stream& stream);
+    void recycle_(uint16_t buffer_id);
+    void complete_(Waiter& waiter);
+    void post_(std::coroutine_handle<> handle);
+    void wakeup_();
+
+public:
+    /**
+     * Creates a reactor and starts its event loop.
+     *
+     * @param pool The thread pool on which waiting coroutines are resumed.
+     * @param backend The preferred backend. Falls back to epoll if io_uring is not available.
+     * @param number_of_resolvers The number of threads doing blocking name resolution.
+     * @return A running reactor.
+     */
+    Reactor(ThreadPool& pool, Backend backend = Backend::IO_URING, size_t number_of_resolvers = 16);
+
+    /**
+     * Gets the backend in use.
+     *
+     * @return The backend.
+     */
+    Backend getBackend() const;
+
+    /**
+     * Starts a task on the thread pool without waiting for it. The task is destroyed when it completes.
+     *
+     * @param task The task to run.
+     */
+    void spawn(Task<void> task);
+
+    /**
+     * Waits until a socket is readable.
+     *
+     * @param fd The socket.
+     * @param deadline When to give up waiting.
+     * @return Awaitable resuming with true if readable, or false on timeout.
+     */
+    IoAwaiter readable(int fd, Clock::time_point deadline);
+
+    /**
+     * Waits until a socket is writable.
+     *
+     * @param fd The socket.
+     * @param deadline When to give up waiting.
+     * @return Awaitable resuming with true if writable, or false on timeout.
+     */
+    IoAwaiter writable(int fd, Clock::time_point deadline);
+
+    /**
+     * Waits until a point in time.
+     *
+     * @param time_point When to resume.
+     * @return Awaitable.
+     */
+    IoAwaiter sleepUntil(Clock::time_point time_point);
+
+    /**
+     * Waits for some time.
+     *
+     * @param duration How long to wait.
+     * @return Awaitable.
+     */
+    IoAwaiter sleepFor(Clock::duration duration);
+
+    /**
+     * Resolves a hostname without blocking the thread pool.
+     *
+     * @param hostname The hostname to resolve.
+     * @param port The port to connect to.
+     * @return Awaitable resuming with the resolved addresses.
+     */
+    ResolveAwaiter resolve(const std::string& hostname, const std::string& port);
+
+    /**
+     * Connects a non-blocking socket.
+     *
+     * @param fd The socket.
+     * @param address The address to connect to.
+     * @param address_length The length of the address.
+     * @param deadline When to give up.
+     * @return 0 on success, negative errno on failure, or -ETIMEDOUT.
+     */
+    Task<ssize_t> connect(int fd, const sockaddr* address, socklen_t address_length, Clock::time_point deadline);
+
+    /**
+     * Sends some data over a non-blocking socket. May send less than asked for.
+     *
+     * @param fd The socket.
+     * @param data The data.
+     * @param length The length of the data.
+     * @param deadline When to give up.
+     * @return The number of bytes sent, negative errno on failure, or -ETIMEDOUT.
+     */
+    Task<ssize_t> send(int fd, const char* data, size_t length, Clock::time_point deadline);
+
+    /**
+     * Receives some data from a non-blocking socket.
+     *
+     * @param fd The socket.
+     * @param buffer Where to put the data.
+     * @param length The size of the buffer.
+     * @param deadline When to give up.
+     * @return The number of bytes received, 0 if the peer has closed, negative errno on failure, or -ETIMEDOUT.
+     */
+    Task<ssize_t> recv(int fd, char* buffer, size_t length, Clock::time_point deadline);
+
+    /**
+     * Closes a socket, cancelling what the reactor still has in flight for it.
+     *
+     * @param fd The socket.
+     */
+    void close(int fd);
+
+    /**
+     * Stops the event loop and the resolvers. Nothing is resumed afterwards.
+     * Coroutines still waiting are destroyed with the reactor, so the thread pool must be stopped before that.
+     */
+    void stop();
+
+    /**
+     * Stops the reactor and destroys every spawned task that is still waiting.
+     */
+    ~Reactor();
+};
+
+
+#endif //PARALLELWEBCRAWLER_REACTOR_H
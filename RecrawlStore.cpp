@@ -0,0 +1,283 @@
+//
+// Created by Liu Xinan on 19/10/26.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include "RecrawlStore.h"
+
+
+const uint32_t RecrawlStore::MAGIC = 0x52435750;    // "PWCR"
+const uint32_t RecrawlStore::VERSION = 1;
+const int64_t RecrawlStore::MIN_REVISIT_INTERVAL = 60 * 60;
+const int64_t RecrawlStore::MAX_REVISIT_INTERVAL = 30 * 24 * 60 * 60;
+
+namespace {
+
+template<typename T>
+void write(std::ofstream& file, T value) {
+    file.write((const char*) &value, sizeof(value));
+}
+
+template<typename T>
+T read(std::ifstream& file) {
+    T value = T();
+    file.read((char*) &value, sizeof(value));
+    return value;
+}
+
+void writeString(std::ofstream& file, const std::string& value) {
+    write<uint32_t>(file, (uint32_t) value.length());
+    file.write(value.data(), value.length());
+}
+
+/**
+ * Reads the number of items that follow, each of which takes at least a given number of bytes in the file.
+ * Throws a string if the rest of the file cannot hold that many, rather than allocating whatever a corrupted count says.
+ */
+uint32_t readCount(std::ifstream& file, size_t file_size, size_t min_item_size) {
+    const uint32_t count = read<uint32_t>(file);
+    if (!file || (uint64_t) count * min_item_size > file_size - (size_t) file.tellg()) {
+        throw std::string("Corrupted recrawl index.");
+    }
+    return count;
+}
+
+std::string readString(std::ifstream& file) {
+    const uint32_t length = read<uint32_t>(file);
+    // Guards against allocating whatever a corrupted length says.
+    if (!file || length > (1 << 20)) {
+        throw std::string("Corrupted recrawl index.");
+    }
+    std::string value(length, '\0');
+    file.read(&value[0], length);
+    return value;
+}
+
+}
+
+RecrawlStore::RecrawlStore(const std::string& path)
+        : path_(path) {
+    std::ifstream file(path_, std::ios::binary);
+    if (!file.is_open()) {
+        // First run, nothing to remember yet.
+        return;
+    }
+
+    file.seekg(0, std::ios::end);
+    const size_t file_size = (size_t) file.tellg();
+    file.seekg(0, std::ios::beg);
+
+    try {
+        if (read<uint32_t>(file) != MAGIC || read<uint32_t>(file) != VERSION) {
+            throw std::string("Not a recrawl index.");
+        }
+
+        // Every url takes at least its length.
+        std::vector<std::string> urls(readCount(file, file_size, sizeof(uint32_t)));
+        for (auto& url : urls) {
+            url = readString(file);
+        }
+        const auto urlAt = [&urls](uint32_t index) -> const std::string& {
+            if (index >= urls.size()) {
+                throw std::string("Corrupted recrawl index.");
+            }
+            return urls[index];
+        };
+
+        const uint32_t number_of_records = read<uint32_t>(file);
+        for (uint32_t i = 0; i < number_of_records && file; ++i) {
+            Record& record = records_[urlAt(read<uint32_t>(file))];
+            record.etag = readString(file);
+            record.last_modified = readString(file);
+            record.content_hash = read<uint64_t>(file);
+            record.depth = read<uint32_t>(file);
+            record.first_visit = read<int64_t>(file);
+            record.last_visit = read<int64_t>(file);
+            record.next_visit = read<int64_t>(file);
+            record.checks = read<uint32_t>(file);
+            record.changes = read<uint32_t>(file);
+            // Every outlink takes its index.
+            record.outlinks.resize(readCount(file, file_size, sizeof(uint32_t)));
+            for (auto& outlink : record.outlinks) {
+                outlink = urlAt(read<uint32_t>(file));
+            }
+        }
+
+        if (!file) {
+            throw std::string("Corrupted recrawl index.");
+        }
+    } catch (const std::string& e) {
+        fprintf(stderr, "Cannot load recrawl index %s: %s\n", path_.c_str(), e.c_str());
+        throw;
+    }
+
+    fprintf(stderr, "Loaded %zu pages from recrawl index %s.\n", records_.size(), path_.c_str());
+}
+
+bool RecrawlStore::find(const std::string& url, Record& record) const {
+    std::unique_lock<std::mutex> lock(lock_);
+
+    const auto found = records_.find(url);
+    if (found == records_.end()) {
+        return false;
+    }
+    record = found->second;
+    return true;
+}
+
+std::vector<std::pair<std::string, unsigned>> RecrawlStore::getDue() const {
+    std::unique_lock<std::mutex> lock(lock_);
+
+    std::vector<std::pair<std::string, unsigned>> due;
+    for (const auto& record : records_) {
+        if (isDue(record.second)) {
+            due.emplace_back(record.first, record.second.depth);
+        }
+    }
+    return due;
+}
+
+bool RecrawlStore::isDue(const Record& record) {
+    return record.next_visit <= now_();
+}
+
+RecrawlStore::Change RecrawlStore::visit(const std::string& url, unsigned depth, const WebPage& page) {
+    const std::string& code = page.getResponseCode();
+    const bool is_not_modified = code == "304";
+    if (code[0] != '2' && !is_not_modified) {
+        return Change::UNCHANGED;
+    }
+
+    const int64_t now = now_();
+
+    std::unique_lock<std::mutex> lock(lock_);
+
+    const auto found = records_.find(url);
+    const bool is_new = found == records_.end();
+    if (is_new && is_not_modified) {
+        // We never asked for this one conditionally, nothing to update.
+        return Change::UNCHANGED;
+    }
+    Record& record = is_new ? records_[url] : found->second;
+
+    // A 304 may come with fresh validators, and leaves out those that have not changed.
+    if (!page.getHeader("etag").empty() || !is_not_modified) {
+        record.etag = page.getHeader("etag");
+    }
+    if (!page.getHeader("last-modified").empty() || !is_not_modified) {
+        record.last_modified = page.getHeader("last-modified");
+    }
+    record.depth = is_new ? depth : std::min(record.depth, depth);
+
+    bool is_changed = false;
+    if (!is_not_modified) {
+        // Servers without validators still tell us whether the page changed through its content.
+        is_changed = !is_new && record.content_hash != page.getContentHash();
+        record.content_hash = page.getContentHash();
+        record.outlinks.clear();
+        for (const auto& links : page.getLinks()) {
+            for (const auto& link : links.second) {
+                record.outlinks.push_back(link.getUrl());
+            }
+        }
+    }
+
+    schedule_(record, is_changed, now);
+    return is_new ? Change::NEW : is_changed ? Change::CHANGED : Change::UNCHANGED;
+}
+
+void RecrawlStore::save() const {
+    std::unique_lock<std::mutex> lock(lock_);
+
+    // Every url goes into the string table once, whether it is a page or only linked to.
+    std::vector<const std::string*> urls;
+    std::unordered_map<std::string, uint32_t> indices;
+    const auto indexOf = [&urls, &indices](const std::string& url) {
+        const auto inserted = indices.emplace(url, (uint32_t) urls.size());
+        if (inserted.second) {
+            urls.push_back(&inserted.first->first);
+        }
+        return inserted.first->second;
+    };
+    for (const auto& record : records_) {
+        indexOf(record.first);
+        for (const auto& outlink : record.second.outlinks) {
+            indexOf(outlink);
+        }
+    }
+
+    // Written next to the index and renamed over it, so that a crash never leaves half an index behind.
+    const std::string temporary_path = path_ + ".tmp";
+    {
+        std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+        write<uint32_t>(file, MAGIC);
+        write<uint32_t>(file, VERSION);
+
+        write<uint32_t>(file, (uint32_t) urls.size());
+        for (const auto url : urls) {
+            writeString(file, *url);
+        }
+
+        write<uint32_t>(file, (uint32_t) records_.size());
+        for (const auto& record : records_) {
+            write<uint32_t>(file, indices[record.first]);
+            writeString(file, record.second.etag);
+            writeString(file, record.second.last_modified);
+            write<uint64_t>(file, record.second.content_hash);
+            write<uint32_t>(file, record.second.depth);
+            write<int64_t>(file, record.second.first_visit);
+            write<int64_t>(file, record.second.last_visit);
+            write<int64_t>(file, record.second.next_visit);
+            write<uint32_t>(file, record.second.checks);
+            write<uint32_t>(file, record.second.changes);
+            write<uint32_t>(file, (uint32_t) record.second.outlinks.size());
+            for (const auto& outlink : record.second.outlinks) {
+                write<uint32_t>(file, indices[outlink]);
+            }
+        }
+
+        if (!file.flush()) {
+            fprintf(stderr, "Cannot write recrawl index %s\n", temporary_path.c_str());
+            throw std::string("Cannot write recrawl index.");
+        }
+    }
+
+    if (std::rename(temporary_path.c_str(), path_.c_str()) != 0) {
+        fprintf(stderr, "Cannot replace recrawl index %s\n", path_.c_str());
+        throw std::string("Cannot write recrawl index.");
+    }
+    fprintf(stderr, "Saved %zu pages to recrawl index %s.\n", records_.size(), path_.c_str());
+}
+
+int64_t RecrawlStore::now_() {
+    return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void RecrawlStore::schedule_(Record& record, bool is_changed, int64_t now) {
+    if (record.first_visit == 0) {
+        record.first_visit = record.last_visit = now;
+        record.next_visit = now + MIN_REVISIT_INTERVAL;
+        return;
+    }
+
+    ++record.checks;
+    if (is_changed) {
+        ++record.changes;
+    }
+    record.last_visit = now;
+
+    // Changes are taken to come as a Poisson process. We only see whether a page changed between two visits, not
+    // how many times, so the rate is estimated from the share of visits that found no change (Cho and
+    // Garcia-Molina), smoothed so that a page never seen changing still gets checked now and then.
+    const double interval = std::max(1.0, (double) (now - record.first_visit) / record.checks);
+    const double unchanged = record.checks - record.changes + 0.5;
+    const double rate = -std::log(unchanged / (record.checks + 1)) / interval;
+
+    const double revisit_interval = std::min((double) MAX_REVISIT_INTERVAL,
+                                             std::max((double) MIN_REVISIT_INTERVAL, 1 / rate));
+    record.next_visit = now + (int64_t) revisit_interval;
+}
@@ -0,0 +1,113 @@
+//
+// Created by Liu Xinan on 19/10/26.
+//
+
+#ifndef PARALLELWEBCRAWLER_RECRAWLSTORE_H
+#define PARALLELWEBCRAWLER_RECRAWLSTORE_H
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "WebPage.h"
+
+
+/**
+ * What we remember of every page between runs, so that a refresh crawl only downloads what has changed.
+ *
+ * Each url maps to the validators the server gave us (ETag, Last-Modified), a hash of the content and the
+ * outlinks of the page, which are reused when the server answers 304 Not Modified. How often a page is seen to
+ * change decides when it is due to be checked again.
+ *
+ * The whole index is loaded into memory when opened and written back by save(). On disk, every url is stored
+ * once in a string table, and records and outlinks refer to urls by their index.
+ *
+ * Thread safe.
+ */
+class RecrawlStore {
+public:
+    enum class Change {
+        NEW,
+        UNCHANGED,
+        CHANGED
+    };
+
+    struct Record {
+        std::string etag;
+        std::string last_modified;
+        uint64_t content_hash = 0;
+        unsigned depth = 0;
+        int64_t first_visit = 0;    // Seconds since the epoch.
+        int64_t last_visit = 0;
+        int64_t next_visit = 0;
+        uint32_t checks = 0;        // Number of visits after the first.
+        uint32_t changes = 0;       // Number of those where the page had changed.
+        std::vector<std::string> outlinks;
+    };
+
+private:
+    static const uint32_t MAGIC;
+    static const uint32_t VERSION;
+    static const int64_t MIN_REVISIT_INTERVAL;
+    static const int64_t MAX_REVISIT_INTERVAL;
+
+    const std::string path_;
+    std::unordered_map<std::string, Record> records_;
+    mutable std::mutex lock_;
+
+    static int64_t now_();
+    static void schedule_(Record& record, bool is_changed, int64_t now);
+
+public:
+    /**
+     * Opens the index, loading it if the file exists. Throws a string if the file cannot be read.
+     *
+     * @param path The file of the index.
+     * @return The index.
+     */
+    RecrawlStore(const std::string& path);
+
+    /**
+     * Looks up what we know about a url.
+     *
+     * @param url The url.
+     * @param record Set to the record of the url, if there is one.
+     * @return Whether the url is known.
+     */
+    bool find(const std::string& url, Record& record) const;
+
+    /**
+     * Gets the urls that are due to be checked again.
+     *
+     * @return The urls with their depth.
+     */
+    std::vector<std::pair<std::string, unsigned>> getDue() const;
+
+    /**
+     * Gets whether a page is due to be checked again.
+     *
+     * @param record The record of the page.
+     * @return Whether it is due.
+     */
+    static bool isDue(const Record& record);
+
+    /**
+     * Records a visit to a page, and schedules the next one by how often the page changes.
+     * Only 2xx and 304 responses are recorded.
+     *
+     * @param url The url of the page.
+     * @param depth The depth of the page from the seeds.
+     * @param page The response. On 304, the stored content and outlinks are kept.
+     * @return Whether the page is new, unchanged or changed since the last visit.
+     */
+    Change visit(const std::string& url, unsigned depth, const WebPage& page);
+
+    /**
+     * Writes the index back to its file, replacing it atomically. Throws a string if the file cannot be written.
+     */
+    void save() const;
+};
+
+
+#endif //PARALLELWEBCRAWLER_RECRAWLSTORE_H
@@ -0,0 +1,184 @@
+//
+// Created by Liu Xinan on 19/10/26.
+//
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include "SeedLoader.h"
+
+
+const size_t SeedLoader::MIN_CHUNK_SIZE = 1024 * 1024;
+
+std::vector<Frontier::HostBatches> SeedLoader::load(const std::string& path, size_t number_of_threads, Stats& stats) {
+    stats = Stats();
+
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat status;
+    if (fd == -1 || fstat(fd, &status) == -1) {
+        fprintf(stderr, "Cannot read seed file %s: %s\n", path.c_str(), strerror(errno));
+        if (fd != -1) {
+            close(fd);
+        }
+        throw std::string("Cannot read seed file.");
+    }
+    const size_t length = (size_t) status.st_size;
+    if (length == 0) {
+        close(fd);
+        return std::vector<Frontier::HostBatches>();
+    }
+
+    void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        fprintf(stderr, "Cannot map seed file %s: %s\n", path.c_str(), strerror(errno));
+        throw std::string("Cannot read seed file.");
+    }
+    // Every chunk is read from start to end, but all of them at once.
+    madvise(mapped, length, MADV_WILLNEED);
+    const char* data = (const char*) mapped;
+
+    std::vector<Frontier::HostBatches> seeds;
+    try {
+        if (length >= 2 && (unsigned char) data[0] == 0x1f && (unsigned char) data[1] == 0x8b) {
+            const std::string inflated = inflate_(data, length);
+            munmap(mapped, length);
+            mapped = nullptr;
+            seeds = parseAll_(inflated.data(), inflated.length(), number_of_threads, stats);
+        } else {
+            seeds = parseAll_(data, length, number_of_threads, stats);
+        }
+    } catch (const std::string& e) {
+        fprintf(stderr, "Cannot load seed file %s: %s\n", path.c_str(), e.c_str());
+        if (mapped != nullptr) {
+            munmap(mapped, length);
+        }
+        throw;
+    }
+
+    if (mapped != nullptr) {
+        munmap(mapped, length);
+    }
+    return seeds;
+}
+
+std::string SeedLoader::inflate_(const char* data, size_t length) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    // Gzip header, with the largest window.
+    if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK) {
+        throw std::string("Cannot inflate seed file.");
+    }
+    stream.next_in = (Bytef*) data;
+    stream.avail_in = 0;
+
+    // Url lists compress well, start with room for a good ratio and double from there.
+    std::string inflated;
+    inflated.resize(std::max(length * 4, MIN_CHUNK_SIZE));
+    size_t inflated_length = 0;
+    size_t remaining = length;
+
+    int result = Z_OK;
+    while (true) {
+        if (stream.avail_in == 0 && remaining > 0) {
+            // avail_in is only 32 bits wide.
+            stream.avail_in = (uInt) std::min(remaining, (size_t) (1U << 30));
+            remaining -= stream.avail_in;
+        }
+        if (inflated_length == inflated.length()) {
+            inflated.resize(inflated.length() * 2);
+        }
+        stream.next_out = (Bytef*) &inflated[inflated_length];
+        stream.avail_out = (uInt) std::min(inflated.length() - inflated_length, (size_t) (1U << 30));
+        const size_t available = stream.avail_out;
+
+        result = inflate(&stream, Z_NO_FLUSH);
+        inflated_length += available - stream.avail_out;
+
+        if (result == Z_STREAM_END) {
+            if (stream.avail_in == 0 && remaining == 0) {
+                break;
+            }
+            // Another member follows.
+            result = inflateReset(&stream);
+        }
+        if (result == Z_BUF_ERROR && stream.avail_out > 0) {
+            // Out of input before the end of the stream.
+            break;
+        }
+        if (result != Z_OK && result != Z_BUF_ERROR) {
+            break;
+        }
+    }
+    inflateEnd(&stream);
+
+    if (result != Z_STREAM_END) {
+        throw std::string("Corrupted gzip data.");
+    }
+    inflated.resize(inflated_length);
+    return inflated;
+}
+
+std::vector<Frontier::HostBatches> SeedLoader::parseAll_(const char* data, size_t length, size_t number_of_threads,
+                                                         Stats& stats) {
+    // Small lists are not worth the threads.
+    const size_t chunks = std::max((size_t) 1, std::min(number_of_threads, length / MIN_CHUNK_SIZE));
+
+    // Chunks end after a line break, so that no line is cut in two.
+    std::vector<const char*> bounds(1, data);
+    for (size_t i = 1; i < chunks; ++i) {
+        const char* bound = std::max(bounds.back(), data + length * i / chunks);
+        const char* line_break = (const char*) memchr(bound, '\n', data + length - bound);
+        bounds.push_back(line_break == nullptr ? data + length : line_break + 1);
+    }
+    bounds.push_back(data + length);
+
+    std::vector<Frontier::HostBatches> seeds(chunks);
+    std::vector<Stats> chunk_stats(chunks);
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < chunks; ++i) {
+        workers.emplace_back(&SeedLoader::parse_, bounds[i], bounds[i + 1], std::ref(seeds[i]), std::ref(chunk_stats[i]));
+    }
+    parse_(bounds[0], bounds[1], seeds[0], chunk_stats[0]);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    for (const auto& chunk : chunk_stats) {
+        stats.urls += chunk.urls;
+        stats.invalid += chunk.invalid;
+    }
+    return seeds;
+}
+
+void SeedLoader::parse_(const char* begin, const char* end, Frontier::HostBatches& seeds, Stats& stats) {
+    std::string url;
+    while (begin < end) {
+        const char* line_break = (const char*) memchr(begin, '\n', end - begin);
+        const char* line_end = line_break == nullptr ? end : line_break;
+
+        url.clear();
+        std::copy_if(begin, line_end, std::back_inserter(url), [](char x) { return !std::isspace((unsigned char) x); });
+        begin = line_end + 1;
+        if (url.empty()) {
+            continue;
+        }
+
+        ++stats.urls;
+        try {
+            const Link link(url);
+            // Every seed starts at depth 0 with one unit of OPIC cash.
+            addToBatch(seeds[link.getHost()], link, LinkInfo(0, 0, 1.0));
+        } catch (const std::string& e) {
+            ++stats.invalid;
+        }
+    }
+}
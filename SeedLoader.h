@@ -0,0 +1,74 @@
+//
+// Created by Liu Xinan on 19/10/26.
+//
+
+#ifndef PARALLELWEBCRAWLER_SEEDLOADER_H
+#define PARALLELWEBCRAWLER_SEEDLOADER_H
+
+#include <string>
+#include <vector>
+#include "Frontier.h"
+
+
+/**
+ * Reads the seed list of a crawl, one url per line, which may run into millions of urls.
+ *
+ * The file is memory mapped and, if gzipped, inflated in memory. It is then cut into chunks at line breaks, and every
+ * chunk is parsed on a thread of its own into a batch of links keyed by host, ready for Frontier::bootstrap().
+ */
+class SeedLoader {
+public:
+    struct Stats {
+        size_t urls = 0;
+        size_t invalid = 0;
+    };
+
+private:
+    static const size_t MIN_CHUNK_SIZE;
+
+    /**
+     * Inflates a gzipped file, which may have several members such as from `cat a.gz b.gz`. Throws a string if the
+     * file is corrupted.
+     *
+     * @param data The gzipped data.
+     * @param length The length of the data.
+     * @return The inflated data.
+     */
+    static std::string inflate_(const char* data, size_t length);
+
+    /**
+     * Parses the seeds on the lines of a chunk. Whitespace is ignored, and invalid urls are skipped.
+     *
+     * @param begin The start of the chunk.
+     * @param end The end of the chunk.
+     * @param seeds The batch to add the seeds to, with depth 0 and one unit of OPIC cash each.
+     * @param stats Counts the urls and the invalid ones.
+     */
+    static void parse_(const char* begin, const char* end, Frontier::HostBatches& seeds, Stats& stats);
+
+    /**
+     * Parses the seeds in a buffer, chunk by chunk in parallel.
+     *
+     * @param data The buffer.
+     * @param length The length of the buffer.
+     * @param number_of_threads The most threads to use.
+     * @param stats Counts the urls and the invalid ones.
+     * @return The seeds, in a batch for each chunk.
+     */
+    static std::vector<Frontier::HostBatches> parseAll_(const char* data, size_t length, size_t number_of_threads,
+                                                         Stats& stats);
+
+public:
+    /**
+     * Loads the seeds in a file, gzipped or not. Throws a string if the file cannot be read.
+     *
+     * @param path The seed file.
+     * @param number_of_threads The most threads to parse with.
+     * @param stats Set to the number of urls and of invalid ones.
+     * @return The seeds, in a batch for each thread. The same url may be in more than one batch.
+     */
+    static std::vector<Frontier::HostBatches> load(const std::string& path, size_t number_of_threads, Stats& stats);
+};
+
+
+#endif //PARALLELWEBCRAWLER_SEEDLOADER_H
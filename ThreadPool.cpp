@@ -4,39 +4,81 @@
 // Modified from https://github.com/progschj/ThreadPool/
 //
 
+#include <algorithm>
 #include "ThreadPool.h"
 
 
 ThreadPool::ThreadPool(size_t number_of_threads) {
-    auto worker_thread = [this] {
-        std::function<void()> task;
+    resize(number_of_threads);
+}
 
-        while (true) {
-            {  // Acquire lock.
-                std::unique_lock<std::mutex> lock(lock_);
+void ThreadPool::work_() {
+    std::function<void()> task;
+
+    while (true) {
+        {  // Acquire lock.
+            std::unique_lock<std::mutex> lock(lock_);
+
+            // Wait until we should stop, leave, or task queue is not empty.
+            condition_.wait(lock, [this]() { return this->should_stop_ || this->retiring_ > 0 || !this->tasks_.empty(); });
+
+            // If we should stop, we abandon the rest of the task queue and just return.
+            if (should_stop_) {
+                break;
+            }
+            if (retiring_ > 0) {
+                --retiring_;
+                --size_;
+                retired_.push_back(std::this_thread::get_id());
+                return;
+            }
+
+            task = std::move(tasks_.front());
+            tasks_.pop();
+        }  // Release lock.
+
+        // Execute the task.
+        task();
+    }
+    condition_.notify_all();
+}
 
-                // Wait until we should stop, or task queue is not empty.
-                condition_.wait(lock, [this]() { return this->should_stop_ || !this->tasks_.empty(); });
+void ThreadPool::resize(size_t number_of_threads) {
+    number_of_threads = std::max(number_of_threads, (size_t) 1);
 
-                // If we should stop, we abandon the rest of the task queue and just return.
-                if (should_stop_) {
-                    break;
-                }
+    {  // Acquire lock.
+        std::unique_lock<std::mutex> lock(lock_);
 
-                task = std::move(tasks_.front());
-                tasks_.pop();
-            }  // Release lock.
+        if (should_stop_) {
+            return;
+        }
 
-            // Execute the task.
-            task();
+        // They need nothing more from us, joining only waits for their threads to exit.
+        for (const auto& id : retired_) {
+            const auto worker = std::find_if(workers_.begin(), workers_.end(), [&id](const std::thread& worker) {
+                return worker.get_id() == id;
+            });
+            worker->join();
+            workers_.erase(worker);
+        }
+        retired_.clear();
+
+        // Workers that have not left yet are kept on before starting new ones.
+        size_t active = size_ - retiring_;
+        if (number_of_threads > active) {
+            const size_t kept = std::min(retiring_, number_of_threads - active);
+            retiring_ -= kept;
+            active += kept;
+            for (; active < number_of_threads; ++active) {
+                workers_.emplace_back(&ThreadPool::work_, this);
+                ++size_;
+            }
+        } else {
+            retiring_ += active - number_of_threads;
         }
-        condition_.notify_all();
-    };
+    }  // Release lock.
 
-    // Create a vector of worker threads.
-    for (size_t i = 0; i < number_of_threads; ++i) {
-        workers_.emplace_back(worker_thread);
-    }
+    condition_.notify_all();
 }
 
 void ThreadPool::stop() {
@@ -9,6 +9,7 @@
 #include <queue>
 #include <thread>
 #include <future>
+#include <functional>
 
 
 class ThreadPool {
@@ -19,6 +20,13 @@ private:
     std::mutex lock_;
     std::condition_variable condition_;
     bool should_stop_ = false;
+    size_t size_ = 0;    // Number of workers still running.
+    // Workers yet to leave after the pool was made smaller.
+    size_t retiring_ = 0;
+    // Workers that have left, to be joined on the next resize.
+    std::vector<std::thread::id> retired_;
+
+    void work_();
 public:
     /**
      * Create a thread pool of a specified size.
@@ -36,7 +44,15 @@ public:
      * @return The return value of the function.
      */
     template <class F, class... Args>
-    auto enqueue(F&& f, Args&&... args) -> std::future<typename std::result_of<F(Args...)>::type>;
+    auto enqueue(F&& f, Args&&... args) -> std::future<typename std::invoke_result<F, Args...>::type>;
+
+    /**
+     * Changes the number of threads. New workers start right away, extra ones leave once they finish their task.
+     * Workers that have left since the last call are joined.
+     *
+     * @param number_of_threads The number of threads that the thread pool should have.
+     */
+    void resize(size_t number_of_threads);
 
     /**
      * Stops the thread pool.
@@ -51,8 +67,8 @@ public:
 
 
 template<class F, class... Args>
-auto ThreadPool::enqueue(F &&f, Args &&... args) -> std::future<typename std::result_of<F(Args...)>::type> {
-    using return_type = typename std::result_of<F(Args...)>::type;
+auto ThreadPool::enqueue(F &&f, Args &&... args) -> std::future<typename std::invoke_result<F, Args...>::type> {
+    using return_type = typename std::invoke_result<F, Args...>::type;
     const auto task = std::make_shared<std::packaged_task<return_type()>>(std::bind(std::forward<F>(f), std::forward<Args>(args)...));
 
     std::future<return_type> return_value = task->get_future();
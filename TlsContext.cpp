@@ -0,0 +1,98 @@
+//
+// Created by Liu Xinan on 19/10/26.
+//
+
+#include <openssl/err.h>
+#include <cstdio>
+#include "TlsContext.h"
+
+
+const size_t TlsContext::MAX_SESSIONS = 65536;
+
+TlsContext::TlsContext(bool verify_peers)
+        : verify_peers_(verify_peers) {
+    if ((context_ = SSL_CTX_new(TLS_client_method())) == nullptr) {
+        fprintf(stderr, "Cannot create TLS context: %s\n", ERR_error_string(ERR_get_error(), nullptr));
+        throw std::string("Cannot create TLS context.");
+    }
+
+    SSL_CTX_set_min_proto_version(context_, TLS1_2_VERSION);
+    SSL_CTX_set_app_data(context_, this);
+
+    if (verify_peers_) {
+        SSL_CTX_set_verify(context_, SSL_VERIFY_PEER, nullptr);
+        SSL_CTX_set_default_verify_paths(context_);
+    } else {
+        SSL_CTX_set_verify(context_, SSL_VERIFY_NONE, nullptr);
+    }
+
+    // Offer HTTP/2, the server picks.
+    static const unsigned char PROTOCOLS[] = "\x02h2\x08http/1.1";
+    SSL_CTX_set_alpn_protos(context_, PROTOCOLS, sizeof(PROTOCOLS) - 1);
+
+    // We keep the sessions ourselves, keyed by origin, since OpenSSL only caches sessions of servers.
+    SSL_CTX_set_session_cache_mode(context_, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(context_, onNewSession_);
+}
+
+SSL* TlsContext::connect(const std::string& hostname, const std::string& origin) {
+    SSL* ssl = SSL_new(context_);
+    if (ssl == nullptr) {
+        fprintf(stderr, "Cannot create TLS connection: %s\n", ERR_error_string(ERR_get_error(), nullptr));
+        throw std::string("Cannot create TLS connection.");
+    }
+
+    BIO* input = BIO_new(BIO_s_mem());
+    BIO* output = BIO_new(BIO_s_mem());
+    // Running out of input means waiting for more, not the end of the stream.
+    BIO_set_mem_eof_return(input, -1);
+    SSL_set_bio(ssl, input, output);
+
+    SSL_set_connect_state(ssl);
+    SSL_set_tlsext_host_name(ssl, hostname.c_str());
+    if (verify_peers_) {
+        SSL_set1_host(ssl, hostname.c_str());
+    }
+    SSL_set_app_data(ssl, (void*) &origin);
+
+    {  // Acquire lock.
+        std::unique_lock<std::mutex> lock(lock_);
+
+        const auto found = sessions_.find(origin);
+        if (found != sessions_.end()) {
+            SSL_set_session(ssl, found->second);
+        }
+    }  // Release lock.
+
+    return ssl;
+}
+
+TlsContext::~TlsContext() {
+    for (const auto& session : sessions_) {
+        SSL_SESSION_free(session.second);
+    }
+    SSL_CTX_free(context_);
+}
+
+int TlsContext::onNewSession_(SSL* ssl, SSL_SESSION* session) {
+    TlsContext& context = *(TlsContext*) SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl));
+    const std::string& origin = *(const std::string*) SSL_get_app_data(ssl);
+
+    {  // Acquire lock.
+        std::unique_lock<std::mutex> lock(context.lock_);
+
+        // Only the latest ticket is kept, servers may refuse to see the same one twice.
+        const auto found = context.sessions_.find(origin);
+        if (found != context.sessions_.end()) {
+            SSL_SESSION_free(found->second);
+            found->second = session;
+        } else if (context.sessions_.size() < MAX_SESSIONS) {
+            context.sessions_.emplace(origin, session);
+        } else {
+            return 0;
+        }
+    }  // Release lock.
+
+    // We keep the reference we were given.
+    return 1;
+}
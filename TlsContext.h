@@ -0,0 +1,64 @@
+//
+// Created by Liu Xinan on 19/10/26.
+//
+
+#ifndef PARALLELWEBCRAWLER_TLSCONTEXT_H
+#define PARALLELWEBCRAWLER_TLSCONTEXT_H
+
+#include <openssl/ssl.h>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+
+/**
+ * Client side TLS settings shared by all connections, with a cache of sessions to resume.
+ *
+ * The full handshake is what makes HTTPS expensive, so the last session ticket received from each origin is kept
+ * and offered the next time we connect there, letting the server skip the key exchange and certificates.
+ *
+ * Connections are set up with memory BIOs: the caller moves the encrypted bytes between OpenSSL and the socket,
+ * so that they can go through the reactor like any other data. HTTP/2 is offered through ALPN.
+ *
+ * Thread safe.
+ */
+class TlsContext {
+private:
+    static const size_t MAX_SESSIONS;
+
+    SSL_CTX* context_;
+    const bool verify_peers_;
+
+    std::unordered_map<std::string, SSL_SESSION*> sessions_;
+    std::mutex lock_;
+
+    static int onNewSession_(SSL* ssl, SSL_SESSION* session);
+
+public:
+    /**
+     * Creates a client context. Throws a string if OpenSSL cannot be set up.
+     *
+     * @param verify_peers Whether to check certificates against the system trust store and the hostname.
+     * @return A new context.
+     */
+    TlsContext(bool verify_peers = true);
+
+    TlsContext(const TlsContext&) = delete;
+
+    /**
+     * Creates a client connection over memory BIOs, resuming the last session with the origin if there is one.
+     *
+     * @param hostname The host, used for SNI and verification.
+     * @param origin Names the cache entry of the connection, such as host:port. Must outlive the connection.
+     * @return The connection, to be freed with SSL_free().
+     */
+    SSL* connect(const std::string& hostname, const std::string& origin);
+
+    /**
+     * Frees the context and all cached sessions.
+     */
+    ~TlsContext();
+};
+
+
+#endif //PARALLELWEBCRAWLER_TLSCONTEXT_H
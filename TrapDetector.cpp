@@ -0,0 +1,230 @@
+//
+// Created by Liu Xinan on 19/10/26.
+//
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <functional>
+#include <string>
+#include "TrapDetector.h"
+
+
+const size_t TrapDetector::MAX_URL_LENGTH = 2048;
+const unsigned TrapDetector::MAX_DEPTH = 16;
+const unsigned TrapDetector::DEPTH_SLACK = 4;
+const uint32_t TrapDetector::MIN_DEPTH_SAMPLES = 64;
+const unsigned TrapDetector::MAX_SEGMENT_REPEATS = 3;
+const size_t TrapDetector::MAX_PARAMETERS = 8;
+const size_t TrapDetector::MAX_TEMPLATES = 256;
+const size_t TrapDetector::MAX_PARAMETER_NAMES = 32;
+const double TrapDetector::SUSPICIOUS_TEMPLATE_URLS = 1000;
+const double TrapDetector::MAX_TEMPLATE_URLS = 10000;
+const double TrapDetector::MAX_PARAMETER_VALUES = 200;
+
+void TrapDetector::Sketch::add(uint64_t hash) {
+    const unsigned index = (unsigned) (hash % REGISTERS);
+    const uint64_t rest = hash / REGISTERS;
+    // The position of the lowest set bit, the rarer the larger.
+    const uint8_t rank = (uint8_t) (rest == 0 ? 59 : __builtin_ctzll(rest) + 1);
+    registers_[index] = std::max(registers_[index], rank);
+}
+
+double TrapDetector::Sketch::estimate() const {
+    double sum = 0;
+    unsigned zeros = 0;
+    for (const auto rank : registers_) {
+        sum += std::ldexp(1.0, -rank);
+        if (rank == 0) {
+            ++zeros;
+        }
+    }
+
+    const double estimate = 0.709 * REGISTERS * REGISTERS / sum;
+    // Counting empty registers is more accurate for small sets.
+    if (estimate <= 2.5 * REGISTERS && zeros > 0) {
+        return REGISTERS * std::log((double) REGISTERS / zeros);
+    }
+    return estimate;
+}
+
+TrapDetector::Signature TrapDetector::analyze(const Link& link) {
+    Signature signature;
+
+    std::string path = link.getPath();
+    signature.length = path.length();
+    signature.url_hash = hash_(link.getUrl());
+
+    const size_t fragment = path.find('#');
+    if (fragment != std::string::npos) {
+        path.erase(fragment);
+    }
+
+    const size_t query = path.find('?');
+    const std::string resource = path.substr(0, query);
+
+    // The template keeps the shape of the path, with every run of digits replaced, so that /2016/10/26/ and
+    // /2016/10/27/ fall under the same template.
+    std::string shape;
+    std::vector<std::string> segments;
+    size_t start = 0;
+    while (start < resource.length()) {
+        size_t end = resource.find('/', start);
+        if (end == std::string::npos) {
+            end = resource.length();
+        }
+        if (end > start) {
+            segments.push_back(resource.substr(start, end - start));
+
+            shape += '/';
+            for (size_t i = start; i < end; ++i) {
+                if (!std::isdigit((unsigned char) resource[i])) {
+                    shape += resource[i];
+                } else if (i == start || !std::isdigit((unsigned char) resource[i - 1])) {
+                    shape += '#';
+                }
+            }
+        }
+        start = end + 1;
+    }
+    signature.depth = (unsigned) segments.size();
+
+    // Relative links resolved against the wrong base keep adding the same segments one after the other, such as
+    // /a/a/a/ or /a/b/a/b/a/b/. Runs of numbers are left out, /2010/10/10/ is a date. Deeper paths are dropped anyway.
+    if (!segments.empty() && segments.size() <= MAX_DEPTH) {
+        std::vector<bool> is_number(segments.size());
+        for (size_t i = 0; i < segments.size(); ++i) {
+            is_number[i] = std::all_of(segments[i].begin(), segments[i].end(),
+                                       [](char x) { return std::isdigit((unsigned char) x); });
+        }
+
+        signature.max_segment_repeats = 1;
+        for (size_t cycle = 1; cycle * 2 <= segments.size(); ++cycle) {
+            for (size_t i = 0; i + cycle * 2 <= segments.size(); ++i) {
+                if (std::all_of(is_number.begin() + i, is_number.begin() + i + cycle, [](bool x) { return x; })) {
+                    continue;
+                }
+                unsigned repeats = 1;
+                while (i + cycle * (repeats + 1) <= segments.size() &&
+                       std::equal(segments.begin() + i, segments.begin() + i + cycle,
+                                  segments.begin() + i + cycle * repeats)) {
+                    ++repeats;
+                }
+                signature.max_segment_repeats = std::max(signature.max_segment_repeats, repeats);
+            }
+        }
+    }
+
+    // Parameter values are left out of the template, only the names are kept.
+    std::vector<std::string> names;
+    if (query != std::string::npos) {
+        start = query + 1;
+        while (start < path.length()) {
+            size_t end = path.find('&', start);
+            if (end == std::string::npos) {
+                end = path.length();
+            }
+            if (end > start) {
+                const std::string parameter = path.substr(start, end - start);
+                const size_t equals = parameter.find('=');
+                const std::string name = parameter.substr(0, equals);
+                const std::string value = equals == std::string::npos ? "" : parameter.substr(equals + 1);
+                names.push_back(name);
+                signature.parameters.emplace_back(hash_(name), hash_(value));
+            }
+            start = end + 1;
+        }
+    }
+
+    std::sort(names.begin(), names.end());
+    shape += '?';
+    for (const auto& name : names) {
+        shape += name;
+        shape += '&';
+    }
+    signature.template_hash = hash_(shape);
+
+    return signature;
+}
+
+TrapDetector::Verdict TrapDetector::inspect(HostPatterns& patterns, const Signature& signature) const {
+    // No page worth crawling looks like this.
+    if (signature.length > MAX_URL_LENGTH || signature.depth > MAX_DEPTH) {
+        return Verdict::DROP;
+    }
+
+    Verdict verdict = Verdict::ACCEPT;
+
+    // Much deeper than what is usual on this host.
+    if (patterns.samples >= MIN_DEPTH_SAMPLES && signature.depth > medianDepth_(patterns) + DEPTH_SLACK) {
+        verdict = Verdict::DEPRIORITIZE;
+    }
+    if (patterns.depths.size() <= signature.depth) {
+        patterns.depths.resize(signature.depth + 1);
+    }
+    ++patterns.depths[signature.depth];
+    ++patterns.samples;
+
+    if (signature.max_segment_repeats >= MAX_SEGMENT_REPEATS || signature.parameters.size() > MAX_PARAMETERS) {
+        verdict = Verdict::DEPRIORITIZE;
+    }
+
+    // A template behind an endless number of urls is a generator.
+    auto found = patterns.templates.find(signature.template_hash);
+    if (found == patterns.templates.end() && patterns.templates.size() < MAX_TEMPLATES) {
+        found = patterns.templates.emplace(signature.template_hash, Sketch()).first;
+    }
+    if (found == patterns.templates.end()) {
+        // Too many different shapes is suspicious by itself.
+        verdict = Verdict::DEPRIORITIZE;
+    } else {
+        found->second.add(signature.url_hash);
+        const double urls = found->second.estimate();
+        if (urls > MAX_TEMPLATE_URLS) {
+            return Verdict::DROP;
+        }
+        if (urls > SUSPICIOUS_TEMPLATE_URLS) {
+            verdict = Verdict::DEPRIORITIZE;
+        }
+    }
+
+    // Session ids, sort orders and filters take many values for the same content.
+    for (const auto& parameter : signature.parameters) {
+        auto sketch = patterns.parameters.find(parameter.first);
+        if (sketch == patterns.parameters.end()) {
+            if (patterns.parameters.size() >= MAX_PARAMETER_NAMES) {
+                verdict = Verdict::DEPRIORITIZE;
+                continue;
+            }
+            sketch = patterns.parameters.emplace(parameter.first, Sketch()).first;
+        }
+        sketch->second.add(parameter.second);
+        if (sketch->second.estimate() > MAX_PARAMETER_VALUES) {
+            verdict = Verdict::DEPRIORITIZE;
+        }
+    }
+
+    return verdict;
+}
+
+uint64_t TrapDetector::hash_(const std::string& value) {
+    // Mix the bits, the sketches need every bit of the hash to be random.
+    uint64_t hash = std::hash<std::string>()(value);
+    hash ^= hash >> 30;
+    hash *= 0xbf58476d1ce4e5b9ULL;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111ebULL;
+    hash ^= hash >> 31;
+    return hash;
+}
+
+unsigned TrapDetector::medianDepth_(const HostPatterns& patterns) {
+    uint32_t count = 0;
+    for (unsigned depth = 0; depth < patterns.depths.size(); ++depth) {
+        count += patterns.depths[depth];
+        if (count * 2 >= patterns.samples) {
+            return depth;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,106 @@
+//
+// Created by Liu Xinan on 19/10/26.
+//
+
+#ifndef PARALLELWEBCRAWLER_TRAPDETECTOR_H
+#define PARALLELWEBCRAWLER_TRAPDETECTOR_H
+
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "Link.h"
+
+
+/**
+ * Spots crawl traps: calendars, session ids, faceted search and other generators of endless urls.
+ *
+ * Keeps compact statistics of the url patterns of each host, so that a host can be judged by the shape of what it
+ * links to rather than by each url alone. Urls are reduced to a template, with numbers and parameter values taken
+ * out, and the number of distinct urls behind each template and each parameter is counted in small cardinality
+ * sketches. A template or a parameter taking unbounded values is what an infinite url space looks like.
+ *
+ * Parsing is done by analyze(), which needs no state and can run outside of any lock. The statistics of each host
+ * are owned and guarded by the caller.
+ */
+class TrapDetector {
+public:
+    enum class Verdict {
+        ACCEPT,
+        DEPRIORITIZE,
+        DROP
+    };
+
+    /**
+     * The features of a url the detector looks at.
+     */
+    struct Signature {
+        size_t length = 0;
+        unsigned depth = 0;
+        unsigned max_segment_repeats = 0;    // The longest run of the same path segments, numbers aside.
+        uint64_t url_hash = 0;
+        uint64_t template_hash = 0;
+        std::vector<std::pair<uint64_t, uint64_t>> parameters;  // Hashes of names and values.
+    };
+
+    /**
+     * Approximate count of distinct values (HyperLogLog), in 64 bytes with about 13% error.
+     */
+    class Sketch {
+    private:
+        static const unsigned REGISTERS = 64;
+
+        uint8_t registers_[REGISTERS] = {};
+    public:
+        void add(uint64_t hash);
+        double estimate() const;
+    };
+
+    /**
+     * What we know about the urls of a host.
+     */
+    struct HostPatterns {
+        std::vector<uint32_t> depths;    // Number of urls seen at each depth.
+        uint32_t samples = 0;
+        std::unordered_map<uint64_t, Sketch> templates;
+        std::unordered_map<uint64_t, Sketch> parameters;
+        bool is_reported = false;
+    };
+
+private:
+    static const size_t MAX_URL_LENGTH;
+    static const unsigned MAX_DEPTH;
+    static const unsigned DEPTH_SLACK;
+    static const uint32_t MIN_DEPTH_SAMPLES;
+    static const unsigned MAX_SEGMENT_REPEATS;
+    static const size_t MAX_PARAMETERS;
+    static const size_t MAX_TEMPLATES;
+    static const size_t MAX_PARAMETER_NAMES;
+    static const double SUSPICIOUS_TEMPLATE_URLS;
+    static const double MAX_TEMPLATE_URLS;
+    static const double MAX_PARAMETER_VALUES;
+
+    static uint64_t hash_(const std::string& value);
+    static unsigned medianDepth_(const HostPatterns& patterns);
+
+public:
+    /**
+     * Extracts the features of a url.
+     *
+     * @param link The url.
+     * @return Its signature.
+     */
+    static Signature analyze(const Link& link);
+
+    /**
+     * Records a url in the statistics of its host and judges it.
+     *
+     * @param patterns The statistics of the host, updated.
+     * @param signature The signature of the url.
+     * @return Whether to crawl the url normally, crawl it last or not at all.
+     */
+    Verdict inspect(HostPatterns& patterns, const Signature& signature) const;
+};
+
+
+#endif //PARALLELWEBCRAWLER_TRAPDETECTOR_H
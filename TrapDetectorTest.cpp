@@ -0,0 +1,37 @@
+//
+// Created by Liu Xinan on 19/10/26.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include "TrapDetector.h"
+
+
+static bool expect(const std::string& url, TrapDetector::Verdict expected) {
+    const TrapDetector detector;
+    // A host of its own, so that only the url itself is judged.
+    TrapDetector::HostPatterns patterns;
+    const TrapDetector::Verdict verdict = detector.inspect(patterns, TrapDetector::analyze(Link(url)));
+    if (verdict != expected) {
+        fprintf(stderr, "%s: expected verdict %d, got %d\n", url.c_str(), (int) expected, (int) verdict);
+        return false;
+    }
+    return true;
+}
+
+int main() {
+    bool passed = true;
+    // Dates repeat numbers, and the same segment may come back further down the path.
+    passed &= expect("http://h.com/2010/10/10/post", TrapDetector::Verdict::ACCEPT);
+    passed &= expect("http://h.com/docs/api/v2/docs/index.html", TrapDetector::Verdict::ACCEPT);
+    passed &= expect("http://h.com/a/a/", TrapDetector::Verdict::ACCEPT);
+    // Relative links resolved against the wrong base.
+    passed &= expect("http://h.com/a/a/a/", TrapDetector::Verdict::DEPRIORITIZE);
+    passed &= expect("http://h.com/a/b/a/b/a/b/", TrapDetector::Verdict::DEPRIORITIZE);
+    passed &= expect("http://h.com/x/a/b/c/a/b/c/a/b/c/y", TrapDetector::Verdict::DEPRIORITIZE);
+    // Only the limits no page gets near are dropped.
+    passed &= expect("http://h.com/1/2/3/4/5/6/7/8/9/10/11/12/13/14/15/16/17", TrapDetector::Verdict::DROP);
+    passed &= expect("http://h.com/" + std::string(2100, 'a'), TrapDetector::Verdict::DROP);
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
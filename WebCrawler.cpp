@@ -2,121 +2,441 @@
 // Created by Liu Xinan on 24/9/16.
 //
 
+#include <deque>
 #include <string>
+#include <sstream>
 #include <iostream>
 #include <cassert>
 #include "WebCrawler.h"
+#include "ControlSocket.h"
 #include "HttpRequest.h"
 #include "ThreadPool.h"
+#include "Reactor.h"
+#include "SeedLoader.h"
 
 
-const std::chrono::microseconds WebCrawler::CRAWLING_DELAY = std::chrono::microseconds(500);
+const unsigned WebCrawler::MAX_REDIRECTS = 5;
+const unsigned WebCrawler::MAX_CONSECUTIVE_ERRORS = 3;
 
-WebCrawler::WebCrawler(const int target_amount, const std::vector<std::string>& starting_urls)
-        : target_amount_(target_amount) {
-    for (const auto& url : starting_urls) {
-        const Link link(url);
-        pending_links_[link.getHost()].insert(link.getUrl());
-    }
+WebCrawler::WebCrawler(const size_t target_amount, const std::string& seed_file, const Config& config)
+        : target_amount_(target_amount), config_(config), controller_(4, config.max_concurrent_jobs),
+          tls_(config.verify_peers) {
+    frontier_.addScorer(std::unique_ptr<LinkScorer>(new DepthScorer()), 1.0);
+    frontier_.addScorer(std::unique_ptr<LinkScorer>(new InLinkScorer()), 0.5);
+    frontier_.addScorer(std::unique_ptr<LinkScorer>(new OpicScorer()), 1.0);
+    frontier_.addScorer(std::unique_ptr<LinkScorer>(new UrlPatternScorer()), 1.0);
+
+    // Loading is all computation, more threads than cores only get in each other's way.
+    const size_t threads = std::max((size_t) 1, std::min(config.threads, (size_t) std::thread::hardware_concurrency()));
+    const auto start = std::chrono::steady_clock::now();
+    SeedLoader::Stats stats;
+    std::vector<Frontier::HostBatches> seeds = SeedLoader::load(seed_file, threads, stats);
 
-    for (const auto& entry : pending_links_) {
-        domain_queue_.push(entry.first);
+    // Pages known from earlier runs are revisited once they are due, even if nothing links to them this time.
+    if (!config.recrawl_index.empty()) {
+        recrawl_store_.reset(new RecrawlStore(config.recrawl_index));
+        seeds.emplace_back();
+        for (const auto& due : recrawl_store_->getDue()) {
+            try {
+                const Link link(due.first);
+                addToBatch(seeds.back()[link.getHost()], link, LinkInfo(due.second, 0, 1.0));
+            } catch (const std::string& e) {
+                continue;
+            }
+        }
     }
+
+    const size_t number_of_seeds = frontier_.bootstrap(seeds, threads);
+    const auto end = std::chrono::steady_clock::now();
+    fprintf(stderr, "Loaded %zu distinct seeds from %zu urls (%zu invalid) in %lldms.\n", number_of_seeds, stats.urls,
+            stats.invalid, (long long) std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count());
 }
 
-void WebCrawler::start() {
-    fprintf(stderr, "Starting a thread pool of %zu threads.\n", number_of_threads_);
-    ThreadPool pool(number_of_threads_);
+Task<void> WebCrawler::crawl_(Reactor& reactor, std::string hostname, std::vector<Frontier::Entry> links) {
+    // Holds our concurrency slot and reports what we observed when the job ends.
+    ConcurrencyController::Job job(controller_);
+    // Settings changed from now on apply to the next job.
+    const Config config = getConfig_();
+
+    if (links.empty()) {
+        co_return;
+    }
 
-    const auto crawl_job = [this](const std::string& hostname, const std::unordered_set<Link>& links) {
-        assert(links.begin() != links.end());
+    // A host may be linked over both http and https, or on several ports, each needs a connection of its own.
+    // Origins are crawled in the order of their most valuable link. Redirects within the host join the origin
+    // they point to, as long as it is still to be crawled.
+    std::deque<std::vector<const Frontier::Entry*>> origins;
+    std::deque<Frontier::Entry> redirected;
+    const auto addToOrigin = [&origins](const Frontier::Entry* entry, size_t first) {
+        auto origin = std::find_if(origins.begin() + first, origins.end(), [entry](const std::vector<const Frontier::Entry*>& origin) {
+            return origin.front()->link.getProtocol() == entry->link.getProtocol() &&
+                   origin.front()->link.getPort() == entry->link.getPort();
+        });
+        if (origin == origins.end()) {
+            origins.emplace_back();
+            origin = std::prev(origins.end());
+        }
+        origin->push_back(entry);
+    };
+    // What earlier runs know of the pages, to ask for them conditionally.
+    std::unordered_map<std::string, RecrawlStore::Record> known_pages;
+    for (const auto& entry : links) {
+        const Link& link = entry.link;
+        if (link.getProtocol() != "http" && link.getProtocol() != "https") {
+            // Skip non-http urls.
+            continue;
+        }
+
+        RecrawlStore::Record record;
+        if (recrawl_store_ && recrawl_store_->find(link.getUrl(), record)) {
+            if (!RecrawlStore::isDue(record)) {
+                // Checked recently enough for how often it changes.
+                ++recrawl_skipped_;
+                continue;
+            }
+            known_pages.emplace(link.getUrl(), std::move(record));
+        }
+
+        addToOrigin(&entry, 0);
+    }
+
+    Frontier::HostBatches results;
+    bool target_reached = false;
+    std::chrono::milliseconds total_response_time(0);
+    uint32_t number_of_responses = 0;
+    std::string base_url;
+
+    // Back off from this host when it tells us it is overloaded, and speed up again once it recovers.
+    std::chrono::microseconds crawling_delay = config.crawling_delay;
+
+    // The target of a redirect takes the place of the page, at the same depth and with its cash. Loops end at
+    // urls that have been visited already, and chains after MAX_REDIRECTS hops.
+    const auto followRedirect = [&](const Frontier::Entry& entry, const WebPage& page, size_t current_origin) {
+        if (entry.info.redirects >= MAX_REDIRECTS) {
+            fprintf(stderr, "Too many redirects, giving up on %s\n", entry.link.getUrl().c_str());
+            return;
+        }
+        std::string location = page.getHeader("location");
+        if (location.empty()) {
+            return;
+        }
+        if (location.compare(0, 2, "//") == 0) {
+            // Relative to the scheme only.
+            location = entry.link.getProtocol() + ":" + location;
+        }
 
-        // Set host and port from the first link and try to open the connection.
-        const Link first_link = *links.begin();
-        HttpRequest request(first_link.getHost(), first_link.getPort());
         try {
-            request.open();
+            const Link link(location, entry.link.getUrl());
+            if (link.getProtocol() != "http" && link.getProtocol() != "https") {
+                return;
+            }
+
+            const LinkInfo info(entry.info.depth, 1, entry.info.cash, entry.info.redirects + 1);
+            if (link.getHost() != hostname) {
+                addToBatch(results[link.getHost()], link, info);
+                return;
+            }
+
+            // Dropped when its turn comes if it has been visited already.
+            redirected.emplace_back(link, info);
+            addToOrigin(&redirected.back(), current_origin);
+        } catch (const std::string& e) {
+            // Not a url.
+        }
+    };
+
+    for (size_t current_origin = 0; current_origin < origins.size(); ++current_origin) {
+        auto& origin = origins[current_origin];
+        // Set protocol and port from the first link and try to open the connection.
+        const Link& first_link = origin.front()->link;
+        const bool is_secure = first_link.getProtocol() == "https";
+        HttpRequest request(reactor, hostname, first_link.getPort(), is_secure ? &tls_ : nullptr,
+                            config.http2_prior_knowledge);
+        request.setTimeout(controller_.getInitialTimeout());
+        request.setOptions(config.request);
+        // Handshakes count for every connection opened, including those reopened after the host closed one.
+        const auto collectTlsStats = [this, &request]() {
+            tls_handshakes_ += request.getHandshakeCount();
+            tls_resumptions_ += request.getResumptionCount();
+            tls_handshake_time_us_ += request.getHandshakeTime().count();
+        };
+        try {
+            co_await request.open();
         } catch (std::string& e) {
-            return;
+            // Unresolvable, refusing or failing the handshake, the controller needs to hear of it all the same.
+            ++job.errors;
+            job.timeouts += request.getTimeoutCount();
+            collectTlsStats();
+            continue;
         }
 
-        std::unordered_map<std::string, std::unordered_set<Link>> results;
+        uint32_t pages = 0;
+        unsigned consecutive_errors = 0;
+
+        // Links are handed to us most valuable first. Over HTTP/2 they are requested in batches of as many as
+        // the host lets us have in flight, otherwise one at a time.
+        for (size_t start = 0; start < origin.size();) {
+            // Stop then target amount achieved.
+            const size_t number_of_results = number_of_results_;
+            if (number_of_results >= target_amount_) {
+                target_reached = true;
+                break;
+            }
+
+            if (!request.isOpen()) {
+                // The host closed the connection after the last response, or a request failed on it.
+                try {
+                    co_await request.open();
+                } catch (const std::string& e) {
+                    ++job.errors;
+                    break;
+                }
+            }
 
-        for (const auto& link : links) {
-            if (link.getProtocol() != "http") {
-                // Skip non-http urls.
+            // Links are only marked visited right before they are requested, so that those we never get to are
+            // crawled when the host is found again. Those visited by another job since they were queued are dropped.
+            const size_t batch_size = request.isHttp2() ? request.getMaxConcurrentStreams() : 1;
+            std::vector<const Frontier::Entry*> batch;
+            size_t end = start;
+            for (; end < origin.size() && batch.size() < batch_size; ++end) {
+                if (frontier_.claim(hostname, origin[end]->link)) {
+                    batch.push_back(origin[end]);
+                }
+            }
+            if (batch.empty()) {
+                start = end;
                 continue;
             }
 
-            {  // Acquire lock.
-                std::unique_lock<std::mutex> lock(this->lock_);
+            std::vector<std::string> paths;
+            std::vector<HttpRequest::Validators> validators;
+            for (const auto entry : batch) {
+                fprintf(stderr, "[%3zu%%] Crawling %s\n", number_of_results * 100 / target_amount_, entry->link.getUrl().c_str());
+                paths.push_back(entry->link.getPath());
 
-                // Not crawling the same url more than once.
-                if (this->visited_.find(link) != this->visited_.end()) {
-                    // Skip a link if we have already visited it.
-                    continue;
+                validators.emplace_back();
+                const auto known_page = known_pages.find(entry->link.getUrl());
+                if (known_page != known_pages.end()) {
+                    validators.back().etag = known_page->second.etag;
+                    validators.back().last_modified = known_page->second.last_modified;
                 }
+            }
 
-                // Stop then target amount achieved.
-                if (this->results_.size() >= this->target_amount_) {
-                    return;
+            try {
+                // Crawl these pages and put all their links into the result buffer.
+                std::vector<std::pair<size_t, WebPage>> responses;
+                if (request.isHttp2()) {
+                    responses = co_await request.getAll(paths, validators);
+                } else {
+                    responses.emplace_back(0, co_await request.get(paths.front(), validators.front()));
                 }
 
-                // Add candidate into visited set.
-                this->visited_.insert(link);
-                fprintf(stderr, "[%3lu%%] Crawling %s\n", this->results_.size() * 100 / this->target_amount_, link.getUrl().c_str());
-            }  // Release lock.
+                bool is_overloaded = false;
+                for (const auto& response : responses) {
+                    ++job.pages;
+                    ++pages;
 
-            try {
-                // Crawl this page and put all its links into the result buffer.
-                const WebPage page = request.get(link.getPath());
+                    const Frontier::Entry& entry = *batch[response.first];
+                    const WebPage& page = response.second;
+                    const std::string& code = page.getResponseCode();
+                    if (code == "429" || code[0] == '5') {
+                        is_overloaded = true;
+                        continue;
+                    }
+                    if (code == "301" || code == "302" || code == "303" || code == "307" || code == "308") {
+                        followRedirect(entry, page, current_origin);
+                        continue;
+                    }
+                    if (code[0] != '2' && code != "304") {
+                        continue;
+                    }
 
-                // We only care about response code 2xx.
-                if (page.getResponseCode()[0] != '2') {
-                    continue;
+                    if (recrawl_store_) {
+                        const RecrawlStore::Change change = recrawl_store_->visit(entry.link.getUrl(), entry.info.depth, page);
+                        ++(change == RecrawlStore::Change::NEW ? recrawl_new_ :
+                           change == RecrawlStore::Change::CHANGED ? recrawl_changed_ : recrawl_unchanged_);
+                    }
+
+                    const auto known_page = known_pages.find(entry.link.getUrl());
+                    if (code == "304" && known_page != known_pages.end()) {
+                        // Not modified, the links are the same as last time.
+                        std::unordered_map<std::string, std::unordered_set<Link>> outlinks;
+                        for (const auto& url : known_page->second.outlinks) {
+                            try {
+                                const Link link(url);
+                                outlinks[link.getHost()].insert(link);
+                            } catch (const std::string& e) {
+                                continue;
+                            }
+                        }
+                        collectLinks_(entry, outlinks, results);
+                    } else if (code[0] == '2') {
+                        // We only care about response code 2xx.
+                        collectLinks_(entry, page.getLinks(), results);
+                    }
                 }
 
-                for (const auto& new_link : page.getLinks()) {
-                    results[new_link.first].insert(new_link.second.begin(), new_link.second.end());
+                // Back off while the host is overloaded.
+                if (is_overloaded) {
+                    crawling_delay = std::min(config.max_crawling_delay, crawling_delay * 2);
+                } else {
+                    crawling_delay = std::max(config.crawling_delay, crawling_delay / 2);
                 }
-                std::this_thread::sleep_for(this->CRAWLING_DELAY);
+                consecutive_errors = 0;
+                co_await reactor.sleepFor(crawling_delay);
             } catch (const std::string& e) {
-                break;
+                // These pages are lost, the next ones go over a new connection. A host that keeps failing is
+                // given up on.
+                ++job.errors;
+                if (++consecutive_errors >= MAX_CONSECUTIVE_ERRORS) {
+                    break;
+                }
             }
+
+            start = end;
         }
 
-        const auto response_time = request.getAverageResponseTimeMs();
+        job.timeouts += request.getTimeoutCount();
+        job.latencies.merge(request.getLatencies());
+        collectTlsStats();
+        total_response_time += request.getAverageResponseTimeMs() * pages;
+        number_of_responses += pages;
+        if (pages > 0 && base_url.empty()) {
+            base_url = first_link.getBaseUrl();
+        }
 
-        if (response_time.count() == 0) {
-            return;
+        if (target_reached) {
+            break;
         }
+    }
 
-        {  // Acquire lock.
-            std::unique_lock<std::mutex> lock(this->lock_);
+    // Timeouts are already counted on their own.
+    job.errors -= std::min(job.errors, job.timeouts);
 
-            for (const auto& result : results) {
-                // We are not interested in crawling this host one more time.
-                if (this->results_.find(result.first) != this->results_.end()) {
-                    continue;
-                }
+    const auto response_time = total_response_time / std::max(number_of_responses, (uint32_t) 1);
 
-                if (this->pending_links_.find(result.first) == this->pending_links_.end()) {
-                    this->domain_queue_.push(result.first);
-                }
+    if (target_reached || job.pages == 0) {
+        co_return;
+    }
+
+    // Hand over everything we found at once. Finished hosts and visited links are dropped by the frontier.
+    frontier_.merge(results);
+    frontier_.finish(hostname);
+
+    {  // Acquire lock.
+        std::unique_lock<std::mutex> lock(lock_);
+
+        results_[hostname] = Result{base_url, response_time};
+        number_of_results_ = results_.size();
+
+        // Notify the main thread that their might be new items pending.
+        if (results.size() > 0) {
+            condition_.notify_all();
+        }
+    }  // Release lock.
+}
 
-                this->pending_links_[result.first].insert(result.second.cbegin(), result.second.cend());
+Task<void> WebCrawler::runJob_(Reactor& reactor, std::string hostname, std::vector<Frontier::Entry> links) {
+    try {
+        co_await crawl_(reactor, std::move(hostname), std::move(links));
+    } catch (...) {
+        // The job is over all the same.
+    }
+
+    {  // Acquire lock.
+        std::unique_lock<std::mutex> lock(lock_);
+
+        // The main thread may be waiting for the last job to find something.
+        --running_jobs_;
+        condition_.notify_all();
+    }  // Release lock.
+}
+
+Config WebCrawler::getConfig_() {
+    std::unique_lock<std::mutex> lock(config_lock_);
+
+    return config_;
+}
+
+std::string WebCrawler::control_(const std::string& command, ThreadPool& pool) {
+    std::istringstream words(command);
+    std::string verb;
+    std::string key;
+    std::string value;
+    words >> verb >> key;
+    std::getline(words >> std::ws, value);
+
+    try {
+        if (verb == "get") {
+            std::unique_lock<std::mutex> lock(config_lock_);
+
+            return key.empty() ? config_.toString() : key + " = " + config_.get(key) + "\n";
+        }
+
+        if (verb == "set" && !key.empty()) {
+            if (!Config::isLive(key)) {
+                return "error: " + key + " can only be set at startup.\n";
             }
 
-            this->results_[hostname] = response_time;
+            Config config;
+            {  // Acquire lock.
+                std::unique_lock<std::mutex> lock(config_lock_);
 
-            // Notify the main thread that their might be new items pending.
-            if (results.size() > 0) {
-                this->condition_.notify_all();
+                config_.set(key, value);
+                config = config_;
+            }  // Release lock.
+
+            if (key == "threads") {
+                pool.resize(config.threads);
+            } else if (key == "max_concurrent_jobs") {
+                controller_.setMaxLimit(config.max_concurrent_jobs);
             }
-        }  // Release lock.
-    };
+            fprintf(stderr, "Control: %s set to %s.\n", key.c_str(), value.c_str());
+            return "ok\n";
+        }
+    } catch (const std::string& e) {
+        return "error: " + e + "\n";
+    }
+    return "error: Expected get [<key>] or set <key> <value>.\n";
+}
+
+void WebCrawler::collectLinks_(const Frontier::Entry& entry,
+                               const std::unordered_map<std::string, std::unordered_set<Link>>& links,
+                               Frontier::HostBatches& results) {
+    // Every outlink is one hop further from the seeds and gets an even share of this page's cash.
+    size_t number_of_links = 0;
+    for (const auto& new_links : links) {
+        number_of_links += new_links.second.size();
+    }
+    const LinkInfo discovery(entry.info.depth + 1, 1, entry.info.cash / std::max(number_of_links, (size_t) 1));
+
+    for (const auto& new_links : links) {
+        auto& batch = results[new_links.first];
+        for (const auto& new_link : new_links.second) {
+            addToBatch(batch, new_link, discovery);
+        }
+    }
+}
+
+void WebCrawler::start() {
+    const Config config = getConfig_();
+    fprintf(stderr, "Starting a thread pool of %zu threads, with %zu concurrent jobs to start with.\n", config.threads, controller_.getLimit());
+    ThreadPool pool(config.threads);
+    Reactor reactor(pool, config.backend);
+    fprintf(stderr, "Using the %s backend.\n", reactor.getBackend() == Reactor::Backend::IO_URING ? "io_uring" : "epoll");
+
+    // Lets operators retune the crawl without restarting it.
+    std::unique_ptr<ControlSocket> control;
+    if (!config.control_socket.empty()) {
+        control.reset(new ControlSocket(config.control_socket, [this, &pool](const std::string& command) {
+            return control_(command, pool);
+        }));
+    }
 
     while (true) {
+        // Wait for the controller to let another job in.
+        controller_.acquire();
+
         {  // Acquire lock.
             std::unique_lock<std::mutex> lock(lock_);
 
@@ -124,22 +444,46 @@ void WebCrawler::start() {
                 break;
             }
 
-            while (domain_queue_.empty()) {
+            std::string domain;
+            std::vector<Frontier::Entry> links;
+            bool is_exhausted = false;
+            while (!frontier_.pop(domain, links)) {
+                // Nothing pending and no job left that could find more.
+                if (running_jobs_ == 0) {
+                    is_exhausted = true;
+                    break;
+                }
                 condition_.wait(lock);
             }
-
-            const std::string domain = domain_queue_.front();
-            domain_queue_.pop();
-            pool.enqueue(crawl_job, domain, pending_links_[domain]);
-            pending_links_.erase(domain);
+            if (is_exhausted) {
+                fprintf(stderr, "Nothing left to crawl.\n");
+                break;
+            }
+            ++running_jobs_;
+            reactor.spawn(runJob_(reactor, domain, std::move(links)));
         }  // Release lock.
     }
 
     fprintf(stderr, "[100%%] Crawling done. Shutting down threads...\n");
+    control.reset();
+    reactor.stop();
     pool.stop();
 
-    // Print results.
+    const size_t tls_handshakes = tls_handshakes_;
+    if (tls_handshakes > 0) {
+        fprintf(stderr, "TLS handshakes: %zu, %zu resumed, %.1fms on average.\n", tls_handshakes, (size_t) tls_resumptions_,
+                tls_handshake_time_us_ / 1000.0 / tls_handshakes);
+    }
+
+    // Print results. First, so that they are not lost if the recrawl index cannot be saved.
     for (const auto& result : results_) {
-        printf("http://%s: %llims\n", result.first.c_str(), result.second.count());
+        printf("%s: %llims\n", result.second.base_url.c_str(), result.second.response_time.count());
+    }
+    fflush(stdout);
+
+    if (recrawl_store_) {
+        fprintf(stderr, "Recrawl: %zu new, %zu changed, %zu unchanged, %zu not due yet.\n", (size_t) recrawl_new_,
+                (size_t) recrawl_changed_, (size_t) recrawl_unchanged_, (size_t) recrawl_skipped_);
+        recrawl_store_->save();
     }
 }
@@ -12,34 +12,113 @@
 #include <unordered_map>
 #include <thread>
 #include <chrono>
-#include <queue>
+#include <memory>
 #include <mutex>
+#include <atomic>
 #include <condition_variable>
 #include "Link.h"
+#include "Frontier.h"
+#include "HttpRequest.h"
+#include "ConcurrencyController.h"
+#include "Config.h"
+#include "Reactor.h"
+#include "Task.h"
+#include "TlsContext.h"
+#include "WebPage.h"
+#include "RecrawlStore.h"
 
 
+class ThreadPool;
+
 class WebCrawler {
 private:
-    static const std::chrono::microseconds CRAWLING_DELAY;
+    static const unsigned MAX_REDIRECTS;
+    static const unsigned MAX_CONSECUTIVE_ERRORS;
+
+    const size_t target_amount_;
+    // Changed by the control socket while the crawl runs.
+    Config config_;
+    std::mutex config_lock_;
+    ConcurrencyController controller_;
+
+    Frontier frontier_;
+    struct Result {
+        std::string base_url;  // Scheme and host the host was first crawled on, such as https://example.com.
+        std::chrono::milliseconds response_time;
+    };
 
-    const int target_amount_;
-    size_t number_of_threads_ = std::max(std::thread::hardware_concurrency() * 8, 64U);
+    std::unordered_map<std::string, Result> results_;
+    std::atomic<size_t> number_of_results_{0};
 
-    std::unordered_map<std::string, std::unordered_set<Link>> pending_links_;
-    std::queue<std::string> domain_queue_;
-    std::unordered_map<std::string, std::chrono::milliseconds> results_;
-    std::unordered_set<Link> visited_;
+    // Shared by all HTTPS connections, so that they can resume each other's sessions.
+    TlsContext tls_;
+    std::atomic<size_t> tls_handshakes_{0};
+    std::atomic<size_t> tls_resumptions_{0};
+    std::atomic<long long> tls_handshake_time_us_{0};
+
+    // Only in recrawl mode, remembers pages across runs.
+    std::unique_ptr<RecrawlStore> recrawl_store_;
+    std::atomic<size_t> recrawl_new_{0};
+    std::atomic<size_t> recrawl_changed_{0};
+    std::atomic<size_t> recrawl_unchanged_{0};
+    std::atomic<size_t> recrawl_skipped_{0};
 
     std::mutex lock_;
     std::condition_variable condition_;
+    size_t running_jobs_ = 0;
+
+    /**
+     * Crawls a batch of links under the same host over a single connection, and merges what it finds.
+     *
+     * @param reactor The reactor to wait on.
+     * @param hostname The host.
+     * @param links The links to crawl, most valuable first.
+     */
+    Task<void> crawl_(Reactor& reactor, std::string hostname, std::vector<Frontier::Entry> links);
+
+    /**
+     * Runs a crawl job and lets the main thread know when it is over.
+     */
+    Task<void> runJob_(Reactor& reactor, std::string hostname, std::vector<Frontier::Entry> links);
+
+    /**
+     * Gets a copy of the current settings.
+     *
+     * @return The settings.
+     */
+    Config getConfig_();
+
+    /**
+     * Runs a command from the control socket: `get [<key>]` or `set <key> <value>`. Live settings are applied to the
+     * thread pool and the concurrency controller at once, and to jobs and connections as they start.
+     *
+     * @param command The command.
+     * @param pool The thread pool of the crawl.
+     * @return The reply.
+     */
+    std::string control_(const std::string& command, ThreadPool& pool);
+
+    /**
+     * Adds the links of a crawled page to the result buffer, with their depth and share of the page's cash.
+     *
+     * @param entry The link of the page.
+     * @param links The links of the page, keyed by host.
+     * @param results The result buffer.
+     */
+    static void collectLinks_(const Frontier::Entry& entry,
+                              const std::unordered_map<std::string, std::unordered_set<Link>>& links,
+                              Frontier::HostBatches& results);
 public:
     /**
-     * Create a WebCrawler given a list of starting urls.
+     * Create a WebCrawler given a file of starting urls, one per line and optionally gzipped. The urls are loaded
+     * into the frontier in parallel, and invalid ones are skipped.
      *
-     * @param starting_urls
+     * @param target_amount The number of pages to crawl, at least 1.
+     * @param seed_file The file of starting urls. Throws a string if it cannot be read.
+     * @param config The settings of the crawl. In recrawl mode, throws a string if the index cannot be read.
      * @return
      */
-    WebCrawler(const int target_amount, const std::vector<std::string>& starting_urls);
+    WebCrawler(const size_t target_amount, const std::string& seed_file, const Config& config = Config());
 
     /**
      * Start the crawling.
@@ -4,10 +4,12 @@
 
 #include <regex>
 #include <iostream>
+#include <algorithm>
+#include <cctype>
 #include "WebPage.h"
 
 
-const std::regex WebPage::RESPONSE_CODE_RE = std::regex("HTTP/\\d.\\d (\\d{3}) [A-Z]+\r\n");
+const std::regex WebPage::RESPONSE_CODE_RE = std::regex("HTTP/\\d\\.\\d (\\d{3})");
 const std::regex WebPage::URL_RE = std::regex("<\\s*A\\s+[^>]*href\\s*=\\s*\"([^\"\\s]*)\"", std::regex::icase);
 
 
@@ -19,9 +21,26 @@ WebPage::WebPage(const std::string& url, const std::string& response)
     // Split the header and the html.
     if ((found = response.find("\r\n\r\n")) != std::string::npos) {
         header = response.substr(0, found);
-        html_ = response.substr(found, std::string::npos);
+        html_ = response.substr(found + 4, std::string::npos);
     }
 
+    // Every line after the status line is a header.
+    size_t start = header.find("\r\n");
+    while (start != std::string::npos) {
+        start += 2;
+        const size_t end = header.find("\r\n", start);
+        const std::string line = header.substr(start, end == std::string::npos ? std::string::npos : end - start);
+        const size_t colon = line.find(':');
+        if (colon != std::string::npos) {
+            std::string name = line.substr(0, colon);
+            std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::tolower(c); });
+            const size_t value = line.find_first_not_of(" \t", colon + 1);
+            headers_[name] = value == std::string::npos ? "" : line.substr(value);
+        }
+        start = end;
+    }
+    hashContent_();
+
     // Parse the response code.
     std::sregex_token_iterator code_itr(header.begin(), header.end(), RESPONSE_CODE_RE, 1);
     std::sregex_token_iterator end_itr;
@@ -35,14 +54,41 @@ WebPage::WebPage(const std::string& url, const std::string& response)
     }
 }
 
+WebPage::WebPage(const std::string& url, const std::string& response_code,
+                 const std::vector<std::pair<std::string, std::string>>& headers, const std::string& html)
+        : url_(url), responseCode_(response_code), html_(html), headers_(headers.begin(), headers.end()) {
+    hashContent_();
+    if (responseCode_[0] == '2') {
+        parseLinks_();
+    }
+}
+
 const std::string& WebPage::getResponseCode() const {
     return responseCode_;
 }
 
+const std::string& WebPage::getHeader(const std::string& name) const {
+    static const std::string NONE;
+    const auto found = headers_.find(name);
+    return found == headers_.end() ? NONE : found->second;
+}
+
+uint64_t WebPage::getContentHash() const {
+    return contentHash_;
+}
+
 const std::unordered_map<std::string, std::unordered_set<Link>>& WebPage::getLinks() const {
     return links_;
 }
 
+void WebPage::hashContent_() {
+    // FNV-1a, stable across runs unlike std::hash.
+    contentHash_ = 0xcbf29ce484222325ULL;
+    for (const char c : html_) {
+        contentHash_ = (contentHash_ ^ (uint8_t) c) * 0x100000001b3ULL;
+    }
+}
+
 void WebPage::parseLinks_() {
     std::sregex_token_iterator url_itr(html_.begin(), html_.end(), URL_RE, 1);
     std::sregex_token_iterator end_itr;
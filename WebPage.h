@@ -8,6 +8,8 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <string>
+#include <utility>
+#include <vector>
 #include "Link.h"
 
 class WebPage {
@@ -18,9 +20,13 @@ private:
     std::string url_;
     std::string responseCode_;
     std::string html_;
+    // Keyed by lower case name.
+    std::unordered_map<std::string, std::string> headers_;
+    uint64_t contentHash_ = 0;
     std::unordered_map<std::string, std::unordered_set<Link>> links_;
 
     void parseLinks_();
+    void hashContent_();
 
 public:
 
@@ -32,6 +38,17 @@ public:
      */
     WebPage(const std::string& link, const std::string& response);
 
+    /**
+     * Constructs a WebPage object from a response that comes already split, such as over HTTP/2.
+     *
+     * @param response_code The response code.
+     * @param headers The response headers, with lower case names.
+     * @param html The body of the response.
+     * @return A WebPage object.
+     */
+    WebPage(const std::string& link, const std::string& response_code,
+            const std::vector<std::pair<std::string, std::string>>& headers, const std::string& html);
+
     /**
      * Gets the response code.
      *
@@ -39,6 +56,21 @@ public:
      */
     const std::string& getResponseCode() const;
 
+    /**
+     * Gets a response header.
+     *
+     * @param name The name of the header, in lower case.
+     * @return The value of the header, empty if there is none.
+     */
+    const std::string& getHeader(const std::string& name) const;
+
+    /**
+     * Gets a hash of the body, to tell whether the page has changed.
+     *
+     * @return The hash.
+     */
+    uint64_t getContentHash() const;
+
     /**
      * Parses and find out all links in the page.
      *
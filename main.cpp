@@ -1,42 +1,81 @@
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <cstring>
 #include "WebCrawler.h"
 
 void printUsage(const char* executable) {
-    fprintf(stderr, "Usage: ./%s <target amount> <seed file>\n", executable);
+    fprintf(stderr, "Usage: ./%s <target amount> <seed file> [--config <file>] [--set <key>=<value>]...\n"
+                    "       [--epoll] [--insecure] [--h2c] [--recrawl <index file>] [--control <socket file>]\n"
+                    "       [--max-body <KiB>] [--max-header <KiB>]\n", executable);
     exit(EXIT_FAILURE);
 }
 
 int main(int argc, const char** argv) {
-    if (argc != 3) {
+    if (argc < 3) {
         printUsage(argv[0]);
     }
 
-    const int target_amount = atoi(argv[1]);
-    if (target_amount == 0) {
-        printUsage(argv[0]);
-    }
+    // The configuration file comes first, wherever it is given, so that everything else on the command line
+    // overrides it.
+    Config config;
+    try {
+        for (int i = 3; i + 1 < argc; ++i) {
+            if (strcmp(argv[i], "--config") == 0) {
+                config.load(argv[i + 1]);
+            }
+        }
 
-    std::ifstream seed_file(argv[2]);
-    if (!seed_file.is_open()) {
-        fprintf(stderr, "Seed file not found!\n");
+        for (int i = 3; i < argc; ++i) {
+            const bool has_value = i + 1 < argc;
+            if (strcmp(argv[i], "--config") == 0 && has_value) {
+                ++i;
+            } else if (strcmp(argv[i], "--set") == 0 && has_value && strchr(argv[i + 1], '=') != nullptr) {
+                const std::string setting = argv[++i];
+                config.set(setting.substr(0, setting.find('=')), setting.substr(setting.find('=') + 1));
+            } else if (strcmp(argv[i], "--epoll") == 0) {
+                // io_uring is used whenever the kernel supports it, unless asked otherwise.
+                config.set("backend", "epoll");
+            } else if (strcmp(argv[i], "--insecure") == 0) {
+                // Crawl HTTPS hosts without checking their certificates, such as test servers with self-signed ones.
+                config.set("verify_peers", "false");
+            } else if (strcmp(argv[i], "--h2c") == 0) {
+                // Speak HTTP/2 to plain HTTP hosts right away, such as local test servers. HTTPS hosts negotiate it.
+                config.set("h2c", "true");
+            } else if (strcmp(argv[i], "--recrawl") == 0 && has_value) {
+                // Remember pages in this file, and on the next run only download those that have changed.
+                config.set("recrawl_index", argv[++i]);
+            } else if (strcmp(argv[i], "--control") == 0 && has_value) {
+                config.set("control_socket", argv[++i]);
+            } else if (strcmp(argv[i], "--max-body") == 0 && has_value) {
+                // Pages are cut off after this much, and their links taken from what came in.
+                config.set("max_body_kib", argv[++i]);
+            } else if (strcmp(argv[i], "--max-header") == 0 && has_value) {
+                config.set("max_header_kib", argv[++i]);
+            } else {
+                printUsage(argv[0]);
+            }
+        }
+    } catch (const std::string& e) {
+        fprintf(stderr, "%s\n", e.c_str());
         printUsage(argv[0]);
     }
 
-    std::vector<std::string> seeds;
-
-    std::string line;
-    while (std::getline(seed_file, line)) {
-        line.erase(std::remove_if(line.begin(), line.end(), [](char x) { return std::isspace(x); }));
-        if (!line.empty()) {
-            seeds.push_back(line);
-        }
+    char* number_end = nullptr;
+    const long long target_amount = strtoll(argv[1], &number_end, 10);
+    if (number_end == argv[1] || *number_end != '\0' || target_amount <= 0) {
+        fprintf(stderr, "The target amount must be a positive number.\n");
+        printUsage(argv[0]);
     }
 
     const auto start = std::chrono::steady_clock::now();
-    WebCrawler crawler(target_amount, seeds);
-    crawler.start();
+    try {
+        WebCrawler crawler((size_t) target_amount, argv[2], config);
+        crawler.start();
+    } catch (const std::string& e) {
+        fprintf(stderr, "%s\n", e.c_str());
+        return EXIT_FAILURE;
+    }
     const auto end = std::chrono::steady_clock::now();
 
     fprintf(stderr, "\nTime taken: %llims\n", std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count());